@@ -0,0 +1,289 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include "compress.hpp"
+#include "hash.hpp"
+#include "process.hpp"
+#include "runtime_config.hpp"
+#include "util.hpp"
+
+struct cache_entry_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t object_size;
+	uint64_t depfile_size;
+	uint64_t payload_hash; // of the uncompressed object and depfile
+};
+static_assert(sizeof(cache_entry_header) == 32);
+constexpr char cache_magic[4] = { 'P', 'Y', 'R', 'C' };
+constexpr uint32_t cache_format_version = 1;
+constexpr uint64_t cache_trim_target = 90; // percent of the limit left after evicting
+constexpr size_t manifest_entries = 16; // newest first, with different header contents each
+
+std::string default_cache_dir() {
+#if defined(__linux__)
+	if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg)
+		return std::string(xdg) + "/pyruvic/";
+	if (const char *home = getenv("HOME"); home && *home)
+		return std::string(home) + "/.cache/pyruvic/";
+#elif defined(_WIN32)
+	if (const char *local = getenv("LOCALAPPDATA"); local && *local)
+		return std::string(local) + "/pyruvic/cache/";
+#endif
+	return "";
+}
+
+bool object_cache::init(const std::string &cache_dir, uint64_t limit) {
+	dir = cache_dir;
+	size_limit = limit;
+	if (dir.empty())
+		return false;
+	if (!dir.ends_with('/'))
+		dir.push_back('/');
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	if (ec) {
+		dir.clear();
+		return true;
+	}
+	return false;
+}
+bool object_cache::enabled() const {
+	return !dir.empty();
+}
+// debug info records the working directory (DW_AT_comp_dir), so objects of other directories differ - 0 without -g
+uint64_t debug_dir_hash(const std::vector<std::string> &cmd) {
+	bool debug = false;
+	for (const auto &arg : cmd) {
+		if (arg.starts_with("-g"))
+			debug = arg != "-g0";
+	}
+	if (!debug)
+		return 0;
+	std::error_code ec;
+	return hash_string(std::filesystem::current_path(ec).string());
+}
+// files named by the line markers of preprocessed output (# 12 "file" or #line 12 "file"), every header the
+// preprocessor read - also system ones, which depfiles of -MMD leave out
+std::vector<std::string> preprocessed_files(const std::string &text) {
+	std::set<std::string> files;
+	for (size_t pos = 0; pos < text.size();) {
+		size_t end = text.find('\n', pos);
+		if (end == std::string::npos)
+			end = text.size();
+		if (text[pos] == '#') {
+			size_t quote = text.find('"', pos);
+			if (quote < end && text.find_first_not_of(" line0123456789", pos + 1) == quote) {
+				std::string file;
+				for (size_t i = quote + 1; i < end && text[i] != '"'; ++i) {
+					if (text[i] == '\\' && i + 1 < end)
+						++i;
+					file.push_back(text[i]);
+				}
+				// <built-in>, <command-line> and gcc's working directory ("/dir//")
+				if (!file.empty() && !file.starts_with('<') && !file.ends_with("//"))
+					files.insert(std::filesystem::path(file).lexically_normal().string());
+			}
+		}
+		pos = end + 1;
+	}
+	return std::vector<std::string>(files.begin(), files.end());
+}
+bool object_cache::key(const std::vector<std::string> &cmd, std::string &key, std::vector<std::string> &headers) {
+	// the same command preprocessing to stdout, without the outputs
+	std::vector<std::string> preprocess;
+	for (size_t i = 0; i < cmd.size(); ++i) {
+		if (cmd[i] == "-o" || cmd[i] == "-MF")
+			++i;
+		else if (cmd[i] != "-c" && cmd[i] != "-MMD")
+			preprocess.push_back(cmd[i]);
+	}
+	preprocess.push_back("-E");
+	process_result res(run_process(preprocess));
+	if (res.exit_code)
+		return false;
+	headers = preprocessed_files(res.out);
+	uint64_t command = command_fingerprint(cmd);
+	uint64_t debug_dir = debug_dir_hash(cmd);
+	char hex[33];
+	uint64_t halves[2];
+	for (int i = 0; i < 2; ++i) {
+		xxh64 h(i);
+		h.update(&command, sizeof(command));
+		if (debug_dir)
+			h.update(&debug_dir, sizeof(debug_dir));
+		h.update(res.out.data(), res.out.size());
+		halves[i] = h.digest();
+	}
+	snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(halves[0]), static_cast<unsigned long long>(halves[1]));
+	key = hex;
+	return true;
+}
+std::string object_cache::entry_file(const std::string &key) const {
+	return dir + key.substr(0, 2) + "/" + key;
+}
+std::string object_cache::manifest_file(const std::string &direct_key) const {
+	return dir + direct_key.substr(0, 2) + "/" + direct_key + ".m";
+}
+std::string object_cache::direct_key(const std::vector<std::string> &cmd, const std::string &source) {
+	uint64_t command = command_fingerprint(cmd);
+	uint64_t content = current_stamp(source).hash;
+	uint64_t debug_dir = debug_dir_hash(cmd);
+	char hex[33];
+	uint64_t halves[2];
+	for (int i = 0; i < 2; ++i) {
+		xxh64 h(i);
+		h.update(&command, sizeof(command));
+		if (debug_dir)
+			h.update(&debug_dir, sizeof(debug_dir));
+		h.update(&content, sizeof(content));
+		halves[i] = h.digest();
+	}
+	snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(halves[0]), static_cast<unsigned long long>(halves[1]));
+	return hex;
+}
+// key
+// hash path
+// ...
+// (empty line)
+bool object_cache::lookup(const std::string &direct_key, std::string &key) const {
+	if (!enabled())
+		return false;
+	std::string manifest(manifest_file(direct_key));
+	std::ifstream f(manifest);
+	std::string line;
+	while (std::getline(f, key)) {
+		bool unchanged = !key.empty();
+		while (std::getline(f, line) && !line.empty()) {
+			size_t split = line.find(' ');
+			if (!unchanged || split == std::string::npos)
+				continue;
+			unchanged = std::strtoull(line.c_str(), nullptr, 16) == current_stamp(line.substr(split + 1)).hash;
+		}
+		if (unchanged) {
+			std::error_code ec;
+			std::filesystem::last_write_time(manifest, std::filesystem::file_time_type::clock::now(), ec);
+			return true;
+		}
+	}
+	return false;
+}
+void object_cache::remember(const std::string &direct_key, const std::string &key, const std::vector<std::string> &headers) {
+	if (!enabled())
+		return;
+	std::stringstream entry;
+	entry << key << '\n';
+	for (const auto &h : headers) {
+		file_stamp stamp(current_stamp(h));
+		if (stamp.hash == 0)
+			return;
+		entry << std::hex << stamp.hash << ' ' << h << '\n';
+	}
+	entry << '\n';
+	std::string manifest(manifest_file(direct_key));
+	std::string data(entry.str());
+	// keeps older entries with other keys - other headers might come back (switching branches, configurations)
+	std::ifstream f(manifest);
+	std::string line, block, block_key;
+	size_t entries = 1;
+	while (std::getline(f, line)) {
+		if (block.empty())
+			block_key = line;
+		block += line + '\n';
+		if (!line.empty())
+			continue;
+		if (!block_key.empty() && block_key != key && entries < manifest_entries) {
+			data += block;
+			++entries;
+		}
+		block.clear();
+	}
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(manifest).parent_path(), ec);
+	if (!ec && replace_file(manifest, data))
+		stored += data.size();
+}
+bool object_cache::fetch(const std::string &key, const std::string &objfile, const std::string &depfile) const {
+	if (!enabled())
+		return false;
+	std::string entry(entry_file(key));
+	std::string data;
+	if (!read_file(entry, data) || data.size() < sizeof(cache_entry_header))
+		return false;
+	cache_entry_header header;
+	memcpy(&header, data.data(), sizeof(header));
+	std::string payload;
+	bool valid = memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0 && header.version == cache_format_version &&
+		header.object_size <= std::numeric_limits<uint64_t>::max() - header.depfile_size &&
+		decompress_block(std::string_view(data).substr(sizeof(header)), header.object_size + header.depfile_size, payload) &&
+		hash_string(payload) == header.payload_hash;
+	std::error_code ec;
+	if (!valid) {
+		std::filesystem::remove(entry, ec);
+		return false;
+	}
+	if (!replace_file(objfile, payload.substr(0, header.object_size)) || !replace_file(depfile, payload.substr(header.object_size)))
+		return false;
+	// the time of the entry orders evictions
+	std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);
+	return true;
+}
+void object_cache::store(const std::string &key, const std::string &objfile, const std::string &depfile) {
+	if (!enabled())
+		return;
+	std::string object, deps;
+	if (!read_file(objfile, object) || !read_file(depfile, deps))
+		return;
+	std::string payload(object + deps);
+	cache_entry_header header;
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_format_version;
+	header.object_size = object.size();
+	header.depfile_size = deps.size();
+	header.payload_hash = hash_string(payload);
+	std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+	data += compress_block(payload);
+	std::string entry(entry_file(key));
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(entry).parent_path(), ec);
+	if (!ec && replace_file(entry, data))
+		stored += data.size();
+}
+void object_cache::trim() {
+	if (!enabled() || stored == 0)
+		return;
+	stored = 0;
+	struct cached_file {
+		std::filesystem::path path;
+		uint64_t size;
+		std::filesystem::file_time_type time;
+	};
+	std::vector<cached_file> files;
+	uint64_t total = 0;
+	std::error_code ec;
+	for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if (!it->is_regular_file(ec))
+			continue;
+		cached_file f{ it->path(), it->file_size(ec), it->last_write_time(ec) };
+		total += f.size;
+		files.push_back(std::move(f));
+	}
+	if (total <= size_limit)
+		return;
+	std::sort(files.begin(), files.end(), [](const cached_file &a, const cached_file &b) { return a.time < b.time; });
+	uint64_t target = size_limit / 100 * cache_trim_target;
+	for (const auto &f : files) {
+		if (total <= target)
+			break;
+		if (std::filesystem::remove(f.path, ec))
+			total -= f.size;
+	}
+}
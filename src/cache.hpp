@@ -0,0 +1,48 @@
+#ifndef __CACHE_HPP__
+#define __CACHE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint64_t default_cache_size = 5ull * 1024 * 1024 * 1024;
+
+// content addressed cache of compiler outputs shared by every project of the user (~/.cache/pyruvic by default)
+// entries hold the object and the depfile, LZ4 compressed - the least recently used ones are evicted above the size limit
+// manifests find entries without preprocessing (direct mode) - by the command and the source, they list the headers
+// earlier compiles read with their content and the entry each set of headers produced
+// (all of them as the preprocessor named them, system headers too - an upgraded library changes the key)
+class object_cache {
+public:
+	// disabled with an empty directory, true on error
+	bool init(const std::string &dir, uint64_t size_limit);
+	bool enabled() const;
+	// key of a compile command - its fingerprint and the preprocessed source, false when it doesn't preprocess
+	// with -g also the working directory, which the debug info records (as for the remote cache, which shares the keys)
+	// headers are the files the preprocessor read, for remember
+	static bool key(const std::vector<std::string> &cmd, std::string &key, std::vector<std::string> &headers);
+	// key of a manifest - the command's fingerprint and the content of the source (and the working directory with -g)
+	static std::string direct_key(const std::vector<std::string> &cmd, const std::string &source);
+	// key of the entry whose headers are all unchanged, false on a miss
+	bool lookup(const std::string &direct_key, std::string &key) const;
+	// headers as the compiler read them, relative paths are relative to the working directory
+	void remember(const std::string &direct_key, const std::string &key, const std::vector<std::string> &headers);
+	// writes the outputs of the entry, false on a miss
+	bool fetch(const std::string &key, const std::string &objfile, const std::string &depfile) const;
+	void store(const std::string &key, const std::string &objfile, const std::string &depfile);
+	// evicts entries once stores made the cache larger than its limit
+	void trim();
+private:
+	std::string dir;
+	uint64_t size_limit = 0;
+	std::atomic<uint64_t> stored = 0;
+
+	std::string entry_file(const std::string &key) const;
+	std::string manifest_file(const std::string &direct_key) const;
+};
+
+// the default directory of the cache, empty when the platform has none
+std::string default_cache_dir();
+
+#endif
@@ -1,39 +1,28 @@
 #include "cmdutils.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <sstream>
 #include <thread>
 #include <vector>
 #include "formatted_out.hpp"
+#include "jobserver.hpp"
+#include "json.hpp"
+#include "process.hpp"
+#include "trace.hpp"
+#include "util.hpp"
 
 constexpr unsigned int progressbar_width = 40;
 
-#ifdef _WIN32
-#define popen _popen
-#define pclose _pclose
-#define WEXITSTATUS
-#endif
-std::string run_and_capture_out(const std::string &cmd, int &return_val) {
-	std::string result;
-	{
-		std::array<char, 1024> buffer;
-		auto pclose_capture = [&return_val](FILE *stream) { return_val = WEXITSTATUS(pclose(stream)); };
-		std::unique_ptr<FILE, decltype(pclose_capture)> pipe(popen(cmd.c_str(), "r"), pclose_capture);
-		if (!pipe) {
-			std::cout << prettyErrorGeneral("Failed to pipe " + cmd, severity::ERROR) << std::endl;
-			return_val = 1;
-			return "";
-		}
-		while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-			result += buffer.data();
-		}
-	}
-	return result;
-}
+extern uint64_t memory_limit;
+extern bool keep_going;
+
 std::string repeat(const std::string &str, int n) {
     std::ostringstream os;
     for(int i = 0; i < n; i++)
@@ -41,100 +30,272 @@ std::string repeat(const std::string &str, int n) {
     return os.str();
 }
 
+bool job_history::load_saved(const std::string &file) {
+	std::ifstream f(file);
+	if (f.bad())
+		return true;
+	std::string str;
+	while (std::getline(f, str)) {
+		std::stringstream ss(str);
+		job_stats stats;
+		std::string key;
+		if (ss >> stats.peak_rss >> stats.duration && std::getline(ss >> std::ws, key))
+			insert(std::make_pair(key, stats));
+	}
+	return false;
+}
+bool job_history::save(const std::string &file) const {
+	std::ofstream f(file);
+	if (f.bad())
+		return true;
+	for (const auto &job : *this) {
+		f << job.second.peak_rss << ' ' << job.second.duration << ' ' << job.first << std::endl;
+	}
+	return false;
+}
+
+std::string build_graph::node::command_line() const {
+	return join_command(args);
+}
+size_t build_graph::add(node n) {
+	if (n.key.empty())
+		n.key = n.command_line();
+	nodes.push_back(std::move(n));
+	return nodes.size() - 1;
+}
+void build_graph::clear() { nodes.clear(); }
+bool build_graph::empty() const { return nodes.empty(); }
+size_t build_graph::size() const { return nodes.size(); }
+const build_graph::node &build_graph::operator[](size_t n) const { return nodes[n]; }
+
+// runs every node of the graph once all of its dependencies succeeded; nodes depending on a failed node are skipped
+// without keep_going the first failure stops dispatching and terminates the running commands
+// cancelled commands are not failures, but their dependents don't run either
+// jobs are only started while their expected peak memory fits into the budget
+// ready jobs with the longest remaining path (by last durations) go first, jobs without history keep graph order
 class multi_command {
 public:
-	multi_command(const std::vector<std::string> &cmds, const std::string &final_cmd, const std::string &note, unsigned int threads) :
-		final(final_cmd), note(note), threadc(threads) {
-		for (const auto &cmd : cmds)
-			cmdqueue.emplace(cmd);
-		totalcmds = cmds.size() + (!final_cmd.empty());
+	multi_command(const build_graph &graph, const std::string &note, unsigned int threads, job_history &stats, uint64_t memory_budget, bool keep_going) :
+		graph(graph), note(note), threadc(threads), stats(stats), memory_budget(memory_budget), keep_going(keep_going),
+		waiting_on(graph.size()), dependents(graph.size()), memory_estimate(graph.size()), priority(graph.size()) {
+		for (size_t i = 0; i < graph.size(); ++i) {
+			waiting_on[i] = graph[i].deps.size();
+			for (size_t dep : graph[i].deps)
+				dependents[dep].push_back(i);
+			auto it = stats.find(graph[i].key);
+			memory_estimate[i] = it == stats.end() || it->second.peak_rss == 0 ? default_job_memory : it->second.peak_rss;
+		}
+		for (size_t i = graph.size(); i-- > 0;) {
+			auto it = stats.find(graph[i].key);
+			uint64_t longest_after = 0;
+			for (size_t d : dependents[i])
+				longest_after = std::max(longest_after, priority[d]);
+			priority[i] = (it == stats.end() ? 0 : it->second.duration) + longest_after;
+		}
+		for (size_t i = 0; i < graph.size(); ++i) {
+			if (waiting_on[i] == 0)
+				make_ready(i);
+		}
+		totalcmds = graph.size();
 	}
 	bool run() {
 		failed = false;
+		cancelled = false;
 		donecmds = 0;
+		running = 0;
+		reserved_memory = 0;
 		print_status();
-		for (unsigned int i = 1; i < threadc; ++i) {
-			threads.emplace_back(new std::thread(&multi_command::work, this));
+		for (unsigned int i = 1; i <= threadc; ++i) {
+			trace_lane(i, "worker " + std::to_string(i));
 		}
-		work();
+		for (unsigned int i = 2; i <= threadc; ++i) {
+			threads.emplace_back(new std::thread(&multi_command::work, this, i));
+		}
+		work(1);
 		for (const auto &t : threads) {
 			t->join();
 		}
 		threads.clear();
-		if (!failed && !final.empty()) {
-			int retval;
-			std::string out = run_and_capture_out(final, retval);
-			failed |= retval;
-			std::cout << out;
-		}
-		if (failed) {
-			std::cout << "\x1b[91m" << repeat("\u2588", progressbar_width) << " failed - \x1b[0m" << note << std::endl;
+		if (failed || donecmds != totalcmds) {
+			std::cout << "\x1b[91m" << repeat("\u2588", progressbar_width) <<
+				(process_interrupted() ? " interrupted - \x1b[0m" : failed ? " failed - \x1b[0m" : " cancelled - \x1b[0m") << note << std::endl;
 			return true;
 		} else {
 			std::cout << "\x1b[92m" << repeat("\u2588", progressbar_width) << " done - \x1b[0m" << note << std::endl;
 		}
 		return false;
 	}
-	void work() {
-		cmdqueue_mutex.lock();
-		while (!cmdqueue.empty()) {
-			std::string cmd = cmdqueue.front();
-			cmdqueue.pop();
-			cmdqueue_mutex.unlock();
-			int retval;
-			std::string out = run_and_capture_out(cmd, retval);
-			failed |= retval;
-			cmdqueue_mutex.lock();
-			++donecmds;
-			stdout_mutex.lock();
-			std::cout << out;
+	void work(unsigned int lane) {
+		std::unique_lock<std::mutex> lock(graph_mutex);
+		while (true) {
+			size_t n;
+			bool picked = false;
+			graph_cv.wait(lock, [this, &n, &picked]() {
+				picked = !stopping() && pick(n);
+				return picked || running == 0 || stopping();
+			});
+			if (!picked)
+				break;
+			++running;
+			reserved_memory += memory_estimate[n];
+			lock.unlock();
+			if (!jobs.acquire()) {
+				lock.lock();
+				--running;
+				reserved_memory -= memory_estimate[n];
+				// an interrupt also stops the wait, that isn't an error of its own
+				if (!process_interrupted())
+					std::cout << prettyErrorGeneral("could not get a job token from the jobserver - " + graph[n].key, severity::ERROR) << std::endl;
+				failed = true;
+				graph_cv.notify_all();
+				continue;
+			}
+			// the build might have stopped while waiting for the token
+			if (stop_picked(lock, n))
+				continue;
+			if (graph[n].up_to_date && graph[n].up_to_date()) {
+				jobs.release();
+				lock.lock();
+				--running;
+				reserved_memory -= memory_estimate[n];
+				finish(n);
+				print_status();
+				graph_cv.notify_all();
+				continue;
+			}
+			if (stop_picked(lock, n))
+				continue;
+			if (graph[n].before)
+				graph[n].before();
+			uint64_t start = trace_now();
+			process_result res = run_process(graph[n].args, graph[n].cancel);
+			trace_slice(graph[n].key, graph[n].kind, lane, start, res.wall_time, {
+				{ "command", json_str(graph[n].command_line()) },
+				{ "exit code", std::to_string(res.exit_code) },
+				{ "wall time (ms)", std::to_string(res.wall_time / 1000) },
+				{ "cpu time (ms)", std::to_string(res.cpu_time / 1000) },
+				{ "peak rss (KiB)", std::to_string(res.peak_rss) } });
+			jobs.release();
+			if (res.exit_code == 0 && graph[n].after)
+				graph[n].after();
+			lock.lock();
+			--running;
+			reserved_memory -= memory_estimate[n];
+			// commands terminated because of an earlier failure, an interrupt or a cancel only add noise
+			bool stale = res.exit_code && graph[n].cancel && *graph[n].cancel;
+			bool quiet = res.exit_code && (stopping() || stale);
+			// and their truncated duration and memory would mislead the scheduling of the next build
+			if (!quiet) {
+				job_stats &js = stats[graph[n].key];
+				if (res.peak_rss)
+					js.peak_rss = res.peak_rss;
+				js.duration = res.wall_time / 1000;
+			}
+			if (stale) {
+				cancelled = true;
+			} else if (res.exit_code) {
+				failed = true;
+				if (!keep_going)
+					terminate_processes();
+			} else {
+				finish(n);
+			}
+			if (!quiet) {
+				std::cout << res.out << std::flush;
+				std::cerr << res.err << std::flush;
+			}
 			print_status();
-			stdout_mutex.unlock();
+			graph_cv.notify_all();
 		}
-		cmdqueue_mutex.unlock();
+	}
+	// gives back the token and the memory of a picked job when the build is stopping, true when it did
+	// (the lock is held again afterwards then)
+	bool stop_picked(std::unique_lock<std::mutex> &lock, size_t n) {
+		lock.lock();
+		if (!stopping()) {
+			lock.unlock();
+			return false;
+		}
+		jobs.release();
+		--running;
+		reserved_memory -= memory_estimate[n];
+		graph_cv.notify_all();
+		return true;
+	}
+	// dependents of a node that succeeded or was up to date can run
+	void finish(size_t n) {
+		++donecmds;
+		for (size_t d : dependents[n]) {
+			if (--waiting_on[d] == 0)
+				make_ready(d);
+		}
+	}
+	bool stopping() const {
+		return process_interrupted() || (failed && !keep_going);
+	}
+	void make_ready(size_t n) {
+		ready.insert(std::upper_bound(ready.begin(), ready.end(), n, [this](size_t a, size_t b) { return priority[a] > priority[b]; }), n);
+	}
+	// takes the first ready node that fits into the memory budget, a lone job is always admitted
+	bool pick(size_t &n) {
+		for (auto it = ready.begin(); it != ready.end(); ++it) {
+			if (running == 0 || reserved_memory + memory_estimate[*it] <= memory_budget) {
+				n = *it;
+				ready.erase(it);
+				return true;
+			}
+		}
+		return false;
 	}
 	void print_status() {
-		unsigned int part_done = (donecmds * progressbar_width) / totalcmds;
+		unsigned int part_done = totalcmds ? (donecmds * progressbar_width) / totalcmds : progressbar_width;
 		unsigned int part_todo = progressbar_width - part_done;
-		unsigned int percent_done = (donecmds * 100) / totalcmds;
+		unsigned int percent_done = totalcmds ? (donecmds * 100) / totalcmds : 100;
 		std::cout << "\x1b[92m" << repeat("\u2588", part_done) << repeat("\u2592", part_todo) <<
 			percent_done << "% " << "\x1b[0m" << note << "        \r" << std::flush;
 		std::cout << std::string(8 + note.size() + progressbar_width, ' ') << '\r';
 	}
 private:
+	const build_graph &graph;
 	std::vector<std::unique_ptr<std::thread>> threads;
-	std::mutex stdout_mutex;
-	std::mutex cmdqueue_mutex;
-	std::queue<std::string> cmdqueue;
-	std::string final;
+	std::mutex graph_mutex;
+	std::condition_variable graph_cv;
 	std::string note;
 	unsigned int threadc;
+	job_history &stats;
+	uint64_t memory_budget;
+	bool keep_going;
+	std::vector<size_t> waiting_on;
+	std::vector<std::vector<size_t>> dependents;
+	std::vector<uint64_t> memory_estimate;
+	std::vector<uint64_t> priority;
+	std::vector<size_t> ready;
+	unsigned int running;
+	uint64_t reserved_memory;
 	unsigned int totalcmds;
 	unsigned int donecmds;
-	std::atomic<int> failed;
+	std::atomic<bool> failed;
+	bool cancelled;
 };
 
-bool run_commands(const std::vector<std::string> &cmds, const std::string &note) {
-	multi_command mc(cmds, "", note, 1);
-	return mc.run();
-}
-bool run_commands_parallel(const std::vector<std::string> &cmds, const std::string &note) {
+unsigned int init_jobserver() {
 	unsigned int threads = std::thread::hardware_concurrency();
 	if (threads < 2) {
 		threads = 1;
 	} else {
 		--threads;
 	}
-	multi_command mc(cmds, "", note, threads);
-	return mc.run();
+	jobs.init(threads);
+	return jobs.slots();
 }
-bool build_using(const std::vector<std::string> &compile_cmds, const std::string &link_cmd, const std::string &note) {
-	unsigned int threads = std::thread::hardware_concurrency();
-	if (threads < 2) {
-		threads = 1;
-	} else {
-		--threads;
-	}
-	multi_command mc(compile_cmds, link_cmd, note, threads);
-	return mc.run();
+uint64_t job_memory_budget() {
+	uint64_t budget = memory_limit ? memory_limit : available_memory();
+	return budget ? budget : std::numeric_limits<uint64_t>::max();
+}
+bool run_graph(const build_graph &graph, const std::string &note, job_history &stats) {
+	multi_command mc(graph, note, init_jobserver(), stats, job_memory_budget(), keep_going);
+	install_interrupt_handler();
+	bool failed = mc.run();
+	remove_interrupt_handler();
+	return failed;
 }
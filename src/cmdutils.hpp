@@ -1,11 +1,54 @@
 #ifndef __CMDUTILS_HPP__
 #define __CMDUTILS_HPP__
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
-bool run_commands(const std::vector<std::string> &cmds, const std::string &note);
-bool run_commands_parallel(const std::vector<std::string> &cmds, const std::string &note);
-bool build_using(const std::vector<std::string> &compile_cmds, const std::string &link_cmd, const std::string &note);
+constexpr uint64_t default_job_memory = 512 * 1024; // KiB, estimate for jobs that never ran before
+
+struct job_stats {
+	uint64_t peak_rss = 0; // KiB
+	uint64_t duration = 0; // ms
+};
+class job_history : public std::map<std::string, job_stats> {
+public:
+	bool load_saved(const std::string &file);
+	bool save(const std::string &file) const;
+};
+
+class build_graph {
+public:
+	struct node {
+		std::vector<std::string> args;
+		std::vector<size_t> deps;
+		std::string key = ""; // identifies the job across builds (output file or command line)
+		std::string kind = "command";
+		std::function<bool()> up_to_date = nullptr; // checked once the dependencies are done, true skips the command (restat, cache hit)
+		std::function<void()> before = nullptr; // runs on the worker right before the command
+		std::function<void()> after = nullptr; // runs once the command succeeded, before its dependents start
+		const std::atomic<bool> *cancel = nullptr; // terminates the command when set - its output went stale
+
+		std::string command_line() const;
+	};
+
+	// nodes can only depend on nodes added before them
+	size_t add(node n);
+	void clear();
+	bool empty() const;
+	size_t size() const;
+	const node &operator[](size_t n) const;
+private:
+	std::vector<node> nodes;
+};
+
+bool run_graph(const build_graph &graph, const std::string &note, job_history &stats);
+// joins or creates the jobserver once, jobs outside the graph take its tokens too - the number of its slots
+unsigned int init_jobserver();
+// KiB the running jobs may take together - the memory limit or the available memory
+uint64_t job_memory_budget();
 
 #endif
@@ -0,0 +1,109 @@
+#include "compress.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+constexpr size_t min_match = 4;
+constexpr size_t last_literals = 5; // the block ends with literals
+constexpr size_t match_search_end = 12; // no match starts in the last bytes
+constexpr size_t max_offset = 65535;
+constexpr int hash_bits = 16;
+
+inline uint32_t read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+void put_length(std::string &out, size_t len) {
+	for (; len >= 255; len -= 255)
+		out.push_back(static_cast<char>(255));
+	out.push_back(static_cast<char>(len));
+}
+void put_sequence(std::string &out, const unsigned char *literals, size_t literal_len, size_t match_len, size_t offset) {
+	size_t match_code = match_len ? match_len - min_match : 0;
+	out.push_back(static_cast<char>(std::min<size_t>(literal_len, 15) << 4 | std::min<size_t>(match_code, 15)));
+	if (literal_len >= 15)
+		put_length(out, literal_len - 15);
+	out.append(reinterpret_cast<const char *>(literals), literal_len);
+	if (!match_len)
+		return;
+	out.push_back(static_cast<char>(offset & 0xff));
+	out.push_back(static_cast<char>(offset >> 8));
+	if (match_code >= 15)
+		put_length(out, match_code - 15);
+}
+
+// greedy matching of 4 byte sequences through a hash table of their last positions
+std::string compress_block(std::string_view in) {
+	const unsigned char *src = reinterpret_cast<const unsigned char *>(in.data());
+	size_t n = in.size();
+	std::string out;
+	out.reserve(n / 2 + 16);
+	std::vector<uint32_t> table(size_t(1) << hash_bits, 0); // position + 1, 0 when empty
+	size_t anchor = 0;
+	if (n > match_search_end) {
+		for (size_t i = 0; i < n - match_search_end;) {
+			uint32_t seq = read32(src + i);
+			uint32_t h = (seq * 2654435761u) >> (32 - hash_bits);
+			size_t candidate = table[h];
+			table[h] = static_cast<uint32_t>(i + 1);
+			if (candidate == 0 || i - (candidate - 1) > max_offset || read32(src + candidate - 1) != seq) {
+				++i;
+				continue;
+			}
+			size_t match = candidate - 1;
+			size_t len = min_match;
+			while (i + len < n - last_literals && src[match + len] == src[i + len])
+				++len;
+			put_sequence(out, src + anchor, i - anchor, len, i - match);
+			i += len;
+			anchor = i;
+		}
+	}
+	put_sequence(out, src + anchor, n - anchor, 0, 0);
+	return out;
+}
+bool decompress_block(std::string_view in, size_t size, std::string &out) {
+	const unsigned char *src = reinterpret_cast<const unsigned char *>(in.data());
+	size_t n = in.size();
+	size_t ip = 0;
+	out.clear();
+	out.reserve(size);
+	auto get_length = [&](size_t &len) {
+		unsigned char b;
+		do {
+			if (ip >= n)
+				return false;
+			b = src[ip++];
+			len += b;
+		} while (b == 255);
+		return true;
+	};
+	while (ip < n) {
+		unsigned char token = src[ip++];
+		size_t literal_len = token >> 4;
+		if (literal_len == 15 && !get_length(literal_len))
+			return false;
+		if (literal_len > n - ip || literal_len > size - out.size())
+			return false;
+		out.append(reinterpret_cast<const char *>(src + ip), literal_len);
+		ip += literal_len;
+		if (ip == n)
+			break;
+		if (n - ip < 2)
+			return false;
+		size_t offset = src[ip] | static_cast<size_t>(src[ip + 1]) << 8;
+		ip += 2;
+		size_t match_len = token & 15;
+		if (match_len == 15 && !get_length(match_len))
+			return false;
+		match_len += min_match;
+		if (offset == 0 || offset > out.size() || match_len > size - out.size())
+			return false;
+		// byte by byte - matches may overlap what they copy
+		for (size_t from = out.size() - offset, i = 0; i < match_len; ++i)
+			out.push_back(out[from + i]);
+	}
+	return out.size() == size;
+}
@@ -0,0 +1,13 @@
+#ifndef __COMPRESS_HPP__
+#define __COMPRESS_HPP__
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md) - fast compression of cache entries
+std::string compress_block(std::string_view in);
+// false when the block is corrupt or doesn't decompress to exactly size bytes
+bool decompress_block(std::string_view in, size_t size, std::string &out);
+
+#endif
@@ -0,0 +1,192 @@
+#include "daemon.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include "formatted_out.hpp"
+#include "process.hpp"
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+constexpr size_t max_request_size = 65536;
+
+sockaddr_un daemon_address() {
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, daemon_socket, sizeof(addr.sun_path) - 1);
+	return addr;
+}
+int connect_daemon() {
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	sockaddr_un addr(daemon_address());
+	if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool forward_to_daemon(const std::vector<std::string> &args, int &exit_code, std::string &reply) {
+	int fd = connect_daemon();
+	if (fd < 0)
+		return false;
+	std::string request;
+	for (const auto &arg : args) {
+		request += arg;
+		request.push_back('\0');
+	}
+	iovec iov{ request.data(), request.size() };
+	alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	std::cout << std::flush;
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+		close(fd);
+		return false;
+	}
+	// the reply is the exit code followed by the reply string
+	std::array<char, 4096> buffer;
+	ssize_t len;
+	while ((len = recv(fd, buffer.data(), buffer.size(), 0)) < 0 && errno == EINTR) { }
+	close(fd);
+	if (len < static_cast<ssize_t>(sizeof(int32_t))) {
+		std::cout << prettyErrorGeneral("the daemon stopped during the build", severity::ERROR) << std::endl;
+		exit_code = -1;
+		reply.clear();
+		return true;
+	}
+	int32_t code;
+	memcpy(&code, buffer.data(), sizeof(code));
+	exit_code = code;
+	reply.assign(buffer.data() + sizeof(code), len - sizeof(code));
+	return true;
+}
+
+// the build is interrupted when the client goes away (Ctrl-C)
+void watch_client(int client, const std::atomic<bool> &done) {
+	bool hung_up = false;
+	while (!done) {
+		if (hung_up) {
+			interrupt_processes();
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			continue;
+		}
+		pollfd pfd{ client, POLLRDHUP, 0 };
+		if (poll(&pfd, 1, 100) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+			hung_up = true;
+	}
+}
+void serve_request(int client, const daemon_handler &handler) {
+	std::vector<char> request(max_request_size);
+	iovec iov{ request.data(), request.size() };
+	alignas(cmsghdr) std::array<char, CMSG_SPACE(2 * sizeof(int))> control{};
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+	ssize_t len;
+	while ((len = recvmsg(client, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) { }
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (len <= 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+		return;
+	int fds[2];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	std::vector<std::string> args;
+	for (ssize_t i = 0, j; i < len; i = j + 1) {
+		for (j = i; j < len && request[j] != '\0'; ++j) { }
+		args.emplace_back(request.data() + i, j - i);
+	}
+
+	std::cout << std::flush;
+	std::cerr << std::flush;
+	int saved_out = dup(STDOUT_FILENO);
+	int saved_err = dup(STDERR_FILENO);
+	dup2(fds[0], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	close(fds[0]);
+	close(fds[1]);
+	std::atomic<bool> done = false;
+	std::thread client_watcher(watch_client, client, std::cref(done));
+	std::string reply;
+	int32_t code = handler(args, reply);
+	done = true;
+	client_watcher.join();
+	// a client that hung up interrupted the build, the next request starts clean
+	clear_interrupt();
+	std::cout << std::flush;
+	std::cerr << std::flush;
+	dup2(saved_out, STDOUT_FILENO);
+	dup2(saved_err, STDERR_FILENO);
+	close(saved_out);
+	close(saved_err);
+
+	std::string response(reinterpret_cast<const char *>(&code), sizeof(code));
+	response += reply;
+	send(client, response.data(), response.size(), MSG_NOSIGNAL);
+}
+bool serve_daemon(const daemon_handler &handler) {
+	int probe = connect_daemon();
+	if (probe >= 0) {
+		close(probe);
+		std::cout << prettyErrorGeneral("a daemon already runs for this project", severity::ERROR) << std::endl;
+		return true;
+	}
+	std::filesystem::create_directories(std::filesystem::path(daemon_socket).parent_path());
+	unlink(daemon_socket); // left behind by a killed daemon
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	sockaddr_un addr(daemon_address());
+	if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) || listen(fd, 16)) {
+		std::cout << prettyErrorGeneral(std::string("could not open ") + daemon_socket + " - " + strerror(errno), severity::ERROR) << std::endl;
+		if (fd >= 0)
+			close(fd);
+		return true;
+	}
+	// clients that went away mustn't kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+	std::cout << prettyErrorGeneral(std::string("daemon listening on ") + daemon_socket, severity::INFO) << std::endl;
+	while (true) {
+		int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		serve_request(client, handler);
+		close(client);
+	}
+	close(fd);
+	unlink(daemon_socket);
+	return false;
+}
+#else
+bool serve_daemon(const daemon_handler &) {
+	std::cout << prettyErrorGeneral("the daemon is only supported on linux", severity::ERROR) << std::endl;
+	return true;
+}
+bool forward_to_daemon(const std::vector<std::string> &, int &, std::string &) {
+	return false;
+}
+#endif
@@ -0,0 +1,20 @@
+#ifndef __DAEMON_HPP__
+#define __DAEMON_HPP__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// resident build server - pyruvic daemon keeps the config and the project loaded, builds are forwarded to it over a unix socket
+// requests carry the client's arguments and its stdout/stderr, so the daemon's output goes straight to the client's terminal
+constexpr const char *daemon_socket = "./.pyr/daemon.sock";
+
+// gets the client's arguments, returns the exit code and fills the reply (target file)
+using daemon_handler = std::function<int(const std::vector<std::string> &args, std::string &reply)>;
+
+// serves requests one by one until the process is killed, true when the socket couldn't be opened
+bool serve_daemon(const daemon_handler &handler);
+// false when no daemon runs for the project
+bool forward_to_daemon(const std::vector<std::string> &args, int &exit_code, std::string &reply);
+
+#endif
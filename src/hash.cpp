@@ -0,0 +1,196 @@
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+constexpr uint64_t prime64_1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t prime64_2 = 0xc2b2ae3d27d4eb4full;
+constexpr uint64_t prime64_3 = 0x165667b19e3779f9ull;
+constexpr uint64_t prime64_4 = 0x85ebca77c2b2ae63ull;
+constexpr uint64_t prime64_5 = 0x27d4eb2f165667c5ull;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+inline uint64_t read64(const unsigned char *p) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+inline uint32_t read32(const unsigned char *p) {
+	return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * prime64_2;
+	return rotl64(acc, 31) * prime64_1;
+}
+inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+	acc ^= xxh64_round(0, val);
+	return acc * prime64_1 + prime64_4;
+}
+
+xxh64::xxh64(uint64_t seed) : acc{ seed + prime64_1 + prime64_2, seed + prime64_2, seed, seed - prime64_1 }, seed(seed) { }
+void xxh64::update(const void *data, size_t len) {
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	total += len;
+	if (buffered + len < buffer.size()) {
+		memcpy(buffer.data() + buffered, p, len);
+		buffered += len;
+		return;
+	}
+	if (buffered) {
+		size_t fill = buffer.size() - buffered;
+		memcpy(buffer.data() + buffered, p, fill);
+		for (int i = 0; i < 4; ++i)
+			acc[i] = xxh64_round(acc[i], read64(buffer.data() + i * 8));
+		p += fill;
+		len -= fill;
+		buffered = 0;
+	}
+	for (; len >= 32; p += 32, len -= 32) {
+		for (int i = 0; i < 4; ++i)
+			acc[i] = xxh64_round(acc[i], read64(p + i * 8));
+	}
+	memcpy(buffer.data(), p, len);
+	buffered = len;
+}
+uint64_t xxh64::digest() const {
+	uint64_t h;
+	if (total >= 32) {
+		h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+		for (int i = 0; i < 4; ++i)
+			h = xxh64_merge(h, acc[i]);
+	} else {
+		h = seed + prime64_5;
+	}
+	h += total;
+	const unsigned char *p = buffer.data();
+	size_t len = buffered;
+	for (; len >= 8; p += 8, len -= 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * prime64_1 + prime64_4;
+	}
+	if (len >= 4) {
+		h ^= static_cast<uint64_t>(read32(p)) * prime64_1;
+		h = rotl64(h, 23) * prime64_2 + prime64_3;
+		p += 4;
+		len -= 4;
+	}
+	for (; len > 0; ++p, --len) {
+		h ^= *p * prime64_5;
+		h = rotl64(h, 11) * prime64_1;
+	}
+	h ^= h >> 33;
+	h *= prime64_2;
+	h ^= h >> 29;
+	h *= prime64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+constexpr uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t rotr32(uint32_t x, int r) {
+	return (x >> r) | (x << (32 - r));
+}
+
+sha256::sha256() : state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } { }
+void sha256::compress(const unsigned char *block) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i)
+		w[i] = static_cast<uint32_t>(block[i * 4]) << 24 | static_cast<uint32_t>(block[i * 4 + 1]) << 16 | static_cast<uint32_t>(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+	for (int i = 16; i < 64; ++i) {
+		uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; ++i) {
+		uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+void sha256::update(const void *data, size_t len) {
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	total += len;
+	if (buffered) {
+		size_t fill = std::min(len, buffer.size() - buffered);
+		memcpy(buffer.data() + buffered, p, fill);
+		buffered += fill;
+		p += fill;
+		len -= fill;
+		if (buffered < buffer.size())
+			return;
+		compress(buffer.data());
+		buffered = 0;
+	}
+	for (; len >= 64; p += 64, len -= 64)
+		compress(p);
+	memcpy(buffer.data(), p, len);
+	buffered = len;
+}
+std::array<unsigned char, 32> sha256::digest() const {
+	sha256 last(*this);
+	uint64_t bits = total * 8;
+	unsigned char padding[72] = { 0x80 };
+	size_t padlen = (buffered < 56 ? 56 : 120) - buffered;
+	for (int i = 0; i < 8; ++i)
+		padding[padlen + i] = static_cast<unsigned char>(bits >> (56 - i * 8));
+	last.update(padding, padlen + 8);
+	std::array<unsigned char, 32> out;
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 4; ++j)
+			out[i * 4 + j] = static_cast<unsigned char>(last.state[i] >> (24 - j * 8));
+	}
+	return out;
+}
+
+uint64_t hash_string(const std::string &str) {
+	xxh64 h;
+	h.update(str.data(), str.size());
+	return h.digest();
+}
+std::string sha256_hex(std::string_view data) {
+	sha256 h;
+	h.update(data.data(), data.size());
+	std::string hex;
+	for (unsigned char c : h.digest()) {
+		hex.push_back("0123456789abcdef"[c >> 4]);
+		hex.push_back("0123456789abcdef"[c & 15]);
+	}
+	return hex;
+}
+bool hash_file(const std::string &file, uint64_t &hash) {
+	std::ifstream f(file, std::ios::binary);
+	if (!f.good())
+		return false;
+	xxh64 h;
+	std::array<char, 65536> buffer;
+	while (f.read(buffer.data(), buffer.size()) || f.gcount() > 0)
+		h.update(buffer.data(), static_cast<size_t>(f.gcount()));
+	if (f.bad())
+		return false;
+	hash = h.digest();
+	return true;
+}
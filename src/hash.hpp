@@ -0,0 +1,45 @@
+#ifndef __HASH_HPP__
+#define __HASH_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// XXH64 (https://github.com/Cyan4973/xxHash) - fast non-cryptographic hash for change detection
+class xxh64 {
+public:
+	xxh64(uint64_t seed=0);
+	void update(const void *data, size_t len);
+	uint64_t digest() const;
+private:
+	std::array<uint64_t, 4> acc;
+	std::array<unsigned char, 32> buffer;
+	size_t buffered = 0;
+	uint64_t total = 0;
+	uint64_t seed;
+};
+
+// SHA-256 (FIPS 180-4) - content digests of the remote cache
+class sha256 {
+public:
+	sha256();
+	void update(const void *data, size_t len);
+	std::array<unsigned char, 32> digest() const;
+private:
+	std::array<uint32_t, 8> state;
+	std::array<unsigned char, 64> buffer;
+	size_t buffered = 0;
+	uint64_t total = 0;
+
+	void compress(const unsigned char *block);
+};
+
+uint64_t hash_string(const std::string &str);
+// lowercase hex of the SHA-256 of the data
+std::string sha256_hex(std::string_view data);
+// false when the file couldn't be read
+bool hash_file(const std::string &file, uint64_t &hash);
+
+#endif
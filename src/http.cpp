@@ -0,0 +1,145 @@
+#include "http.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+using http_clock = std::chrono::steady_clock;
+
+int remaining_ms(http_clock::time_point deadline) {
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - http_clock::now()).count();
+	return left > 0 ? static_cast<int>(left) : 0;
+}
+bool wait_socket(int fd, short events, http_clock::time_point deadline) {
+	pollfd pfd{ fd, events, 0 };
+	int r;
+	while ((r = poll(&pfd, 1, remaining_ms(deadline))) < 0 && errno == EINTR) { }
+	return r > 0;
+}
+int connect_to(const std::string &host, const std::string &port, http_clock::time_point deadline) {
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *addrs;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs))
+		return -1;
+	int fd = -1;
+	for (addrinfo *a = addrs; a && fd < 0; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, a->ai_protocol);
+		if (fd < 0)
+			continue;
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (connect(fd, a->ai_addr, a->ai_addrlen) && (errno != EINPROGRESS || !wait_socket(fd, POLLOUT, deadline) ||
+			getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) || err)) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addrs);
+	return fd;
+}
+// body of a chunked transfer, false when it's malformed
+bool dechunk(const std::string &chunked, std::string &body) {
+	body.clear();
+	size_t pos = 0;
+	while (true) {
+		size_t eol = chunked.find("\r\n", pos);
+		if (eol == std::string::npos)
+			return false;
+		size_t size = std::strtoull(chunked.c_str() + pos, nullptr, 16);
+		pos = eol + 2;
+		if (size == 0)
+			return true;
+		if (size > chunked.size() - pos)
+			return false;
+		body.append(chunked, pos, size);
+		pos += size + 2;
+	}
+}
+
+bool http_request(const std::string &method, const std::string &url, const std::string &body, int timeout_ms, http_response &res) {
+	if (!url.starts_with("http://"))
+		return false;
+	size_t host_start = 7;
+	size_t path_start = url.find('/', host_start);
+	std::string authority(url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start));
+	std::string path(path_start == std::string::npos ? "/" : url.substr(path_start));
+	std::string host(authority), port("80");
+	size_t colon = authority.rfind(':');
+	if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+		host = authority.substr(0, colon);
+		port = authority.substr(colon + 1);
+	}
+	if (host.starts_with('[') && host.ends_with(']'))
+		host = host.substr(1, host.size() - 2);
+
+	auto deadline = http_clock::now() + std::chrono::milliseconds(timeout_ms);
+	int fd = connect_to(host, port, deadline);
+	if (fd < 0)
+		return false;
+	std::string request(method + " " + path + " HTTP/1.1\r\nHost: " + authority + "\r\nContent-Length: " + std::to_string(body.size()) +
+		"\r\nConnection: close\r\n\r\n");
+	request += body;
+	for (size_t sent = 0; sent < request.size();) {
+		ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR) && wait_socket(fd, POLLOUT, deadline))
+			continue;
+		if (n <= 0) {
+			close(fd);
+			return false;
+		}
+		sent += n;
+	}
+	// the server closes the connection after the response
+	std::string response;
+	char buffer[65536];
+	while (true) {
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR) && wait_socket(fd, POLLIN, deadline))
+			continue;
+		if (n < 0) {
+			close(fd);
+			return false;
+		}
+		if (n == 0)
+			break;
+		response.append(buffer, n);
+	}
+	close(fd);
+
+	size_t header_end = response.find("\r\n\r\n");
+	if (!response.starts_with("HTTP/1.") || header_end == std::string::npos)
+		return false;
+	res.status = std::atoi(response.c_str() + response.find(' ') + 1);
+	std::string headers(response.substr(0, header_end));
+	for (auto &c : headers)
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	res.body = response.substr(header_end + 4);
+	if (headers.find("\r\ntransfer-encoding: chunked") != std::string::npos) {
+		std::string chunked(std::move(res.body));
+		if (!dechunk(chunked, res.body))
+			return false;
+	} else if (size_t cl = headers.find("\r\ncontent-length:"); cl != std::string::npos) {
+		size_t length = std::strtoull(headers.c_str() + cl + 17, nullptr, 10);
+		if (res.body.size() < length)
+			return false; // cut off
+		res.body.resize(length);
+	}
+	return true;
+}
+#else
+bool http_request(const std::string &, const std::string &, const std::string &, int, http_response &) {
+	return false;
+}
+#endif
@@ -0,0 +1,15 @@
+#ifndef __HTTP_HPP__
+#define __HTTP_HPP__
+
+#include <string>
+
+struct http_response {
+	int status = 0;
+	std::string body;
+};
+
+// plain HTTP/1.1 (no TLS) with one connection per request - url is http://host[:port]/path
+// false when the server couldn't be reached or didn't answer in time, otherwise res holds the answer (of any status)
+bool http_request(const std::string &method, const std::string &url, const std::string &body, int timeout_ms, http_response &res);
+
+#endif
@@ -0,0 +1,142 @@
+#include "jobserver.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "formatted_out.hpp"
+#include "process.hpp"
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+jobserver jobs;
+
+void jobserver::init(unsigned int default_slots) {
+	if (initialized)
+		return;
+	initialized = true;
+	slotc = default_slots;
+#ifdef __linux__
+	const char *makeflags = getenv("MAKEFLAGS");
+	if (makeflags && join(makeflags))
+		return;
+	serve();
+#endif
+}
+unsigned int jobserver::slots() const {
+	return slotc;
+}
+// the first job runs on the implicit token, every other one needs a token from the jobserver
+bool jobserver::acquire() {
+	{
+		std::lock_guard<std::mutex> lock(tokens_mutex);
+		if (implicit_free) {
+			implicit_free = false;
+			return true;
+		}
+	}
+#ifdef __linux__
+	if (read_fd < 0)
+		return true;
+	while (true) {
+		char token;
+		ssize_t len = read(read_fd, &token, 1);
+		if (len == 1) {
+			std::lock_guard<std::mutex> lock(tokens_mutex);
+			tokens.push_back(token);
+			return true;
+		}
+		if (len < 0 && errno != EAGAIN && errno != EINTR)
+			return false;
+		if (process_interrupted())
+			return false;
+		pollfd pfd{ read_fd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) < 0 && errno != EINTR)
+			return false;
+	}
+#else
+	return true;
+#endif
+}
+void jobserver::release() {
+	std::lock_guard<std::mutex> lock(tokens_mutex);
+	if (tokens.empty()) {
+		implicit_free = true;
+		return;
+	}
+#ifdef __linux__
+	char token = tokens.back();
+	while (write(write_fd, &token, 1) < 0 && errno == EINTR) { }
+#endif
+	tokens.pop_back();
+}
+
+#ifdef __linux__
+bool jobserver::join(const std::string &makeflags) {
+	size_t j = makeflags.find("-j");
+	if (j != std::string::npos && (j == 0 || makeflags[j-1] == ' ')) {
+		unsigned int n = std::strtoul(makeflags.c_str() + j + 2, nullptr, 10);
+		if (n > 0)
+			slotc = n;
+	}
+	size_t auth = makeflags.rfind("--jobserver-auth=");
+	size_t auth_len = 17;
+	if (auth == std::string::npos) {
+		auth = makeflags.rfind("--jobserver-fds=");
+		auth_len = 16;
+	}
+	if (auth == std::string::npos)
+		return false;
+	std::string val(makeflags.substr(auth + auth_len, makeflags.find(' ', auth) - auth - auth_len));
+	if (val.starts_with("fifo:")) {
+		read_fd = open(val.substr(5).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		write_fd = read_fd;
+	} else {
+		size_t comma = val.find(',');
+		if (comma == std::string::npos)
+			return false;
+		int r = std::atoi(val.substr(0, comma).c_str());
+		int w = std::atoi(val.substr(comma + 1).c_str());
+		if (fcntl(r, F_GETFD) >= 0 && fcntl(w, F_GETFD) >= 0) {
+			// a separate non-blocking description of the same pipe, make's own stays blocking
+			read_fd = open(("/proc/self/fd/" + std::to_string(r)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+			write_fd = w;
+		}
+	}
+	if (read_fd < 0) {
+		std::cout << prettyErrorGeneral("jobserver from MAKEFLAGS is unavailable (is the make rule marked with '+'?) - using own", severity::WARN) << std::endl;
+		return false;
+	}
+	return true;
+}
+void jobserver::serve() {
+	int fds[2];
+	if (pipe(fds))
+		return;
+	read_fd = open(("/proc/self/fd/" + std::to_string(fds[0])).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (read_fd < 0)
+		read_fd = fds[0];
+	write_fd = fds[1];
+	for (unsigned int i = 1; i < slotc; ++i) {
+		char token = '+';
+		if (write(write_fd, &token, 1) != 1)
+			break;
+	}
+	// the pipe ends stay inheritable so that make and other jobserver aware children share the tokens
+	std::string fdstr(std::to_string(fds[0]) + "," + std::to_string(fds[1]));
+	std::string makeflags;
+	if (const char *prev_makeflags = getenv("MAKEFLAGS")) {
+		std::stringstream ss(prev_makeflags);
+		std::string flag;
+		while (ss >> flag) {
+			if (!flag.starts_with("-j") && !flag.starts_with("--jobserver-"))
+				makeflags += flag + " ";
+		}
+	}
+	makeflags += "-j" + std::to_string(slotc) + " --jobserver-fds=" + fdstr + " --jobserver-auth=" + fdstr;
+	setenv("MAKEFLAGS", makeflags.c_str(), 1);
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef __JOBSERVER_HPP__
+#define __JOBSERVER_HPP__
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// GNU make compatible jobserver - joins the one in MAKEFLAGS or creates one for the commands pyruvic starts
+class jobserver {
+public:
+	void init(unsigned int default_slots);
+	unsigned int slots() const;
+	bool acquire();
+	void release();
+private:
+	bool initialized = false;
+	bool implicit_free = true;
+	unsigned int slotc = 1;
+	int read_fd = -1;
+	int write_fd = -1;
+	std::vector<char> tokens;
+	std::mutex tokens_mutex;
+
+	bool join(const std::string &makeflags);
+	void serve();
+};
+
+extern jobserver jobs;
+
+#endif
@@ -0,0 +1,218 @@
+#include "json.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+const json_value &json_value::operator[](const std::string &key) const {
+	static const json_value null_value;
+	for (const auto &member : obj) {
+		if (member.first == key)
+			return member.second;
+	}
+	return null_value;
+}
+
+class json_parser {
+public:
+	json_parser(const std::string &text) : text(text), pos(0) { }
+	bool parse(json_value &out) {
+		if (parse_value(out, 0))
+			return true;
+		skip_ws();
+		return pos != text.size();
+	}
+private:
+	const std::string &text;
+	size_t pos;
+
+	void skip_ws() {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+			++pos;
+	}
+	bool literal(const char *lit) {
+		size_t len = std::char_traits<char>::length(lit);
+		if (text.compare(pos, len, lit) != 0)
+			return false;
+		pos += len;
+		return true;
+	}
+	bool parse_value(json_value &out, unsigned int depth) {
+		if (depth > 512)
+			return true;
+		skip_ws();
+		if (pos >= text.size())
+			return true;
+		switch (text[pos]) {
+		case '{': {
+			out.type = json_value::OBJECT;
+			++pos;
+			skip_ws();
+			if (pos < text.size() && text[pos] == '}') {
+				++pos;
+				return false;
+			}
+			while (true) {
+				skip_ws();
+				std::string key;
+				if (pos >= text.size() || text[pos] != '"' || parse_string(key))
+					return true;
+				skip_ws();
+				if (pos >= text.size() || text[pos++] != ':')
+					return true;
+				out.obj.emplace_back(std::move(key), json_value());
+				if (parse_value(out.obj.back().second, depth + 1))
+					return true;
+				skip_ws();
+				if (pos >= text.size())
+					return true;
+				if (text[pos] == '}') {
+					++pos;
+					return false;
+				}
+				if (text[pos++] != ',')
+					return true;
+			}
+		}
+		case '[': {
+			out.type = json_value::ARRAY;
+			++pos;
+			skip_ws();
+			if (pos < text.size() && text[pos] == ']') {
+				++pos;
+				return false;
+			}
+			while (true) {
+				out.arr.emplace_back();
+				if (parse_value(out.arr.back(), depth + 1))
+					return true;
+				skip_ws();
+				if (pos >= text.size())
+					return true;
+				if (text[pos] == ']') {
+					++pos;
+					return false;
+				}
+				if (text[pos++] != ',')
+					return true;
+			}
+		}
+		case '"':
+			out.type = json_value::STRING;
+			return parse_string(out.str);
+		case 't':
+			out.type = json_value::BOOL;
+			out.boolean = true;
+			return !literal("true");
+		case 'f':
+			out.type = json_value::BOOL;
+			return !literal("false");
+		case 'n':
+			return !literal("null");
+		default: {
+			const char *start = text.c_str() + pos;
+			char *end;
+			out.type = json_value::NUMBER;
+			out.number = std::strtod(start, &end);
+			if (end == start)
+				return true;
+			pos += end - start;
+			return false;
+		}
+		}
+	}
+	bool parse_string(std::string &out) {
+		++pos;
+		while (pos < text.size()) {
+			char c = text[pos++];
+			if (c == '"')
+				return false;
+			if (c != '\\') {
+				out.push_back(c);
+				continue;
+			}
+			if (pos >= text.size())
+				return true;
+			switch (text[pos++]) {
+			case '"': out.push_back('"'); break;
+			case '\\': out.push_back('\\'); break;
+			case '/': out.push_back('/'); break;
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u': {
+				unsigned long cp;
+				if (parse_hex4(cp))
+					return true;
+				if (cp >= 0xd800 && cp < 0xdc00 && text.compare(pos, 2, "\\u") == 0) {
+					pos += 2;
+					unsigned long low;
+					if (parse_hex4(low))
+						return true;
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+				}
+				append_utf8(out, cp);
+				break;
+			}
+			default: return true;
+			}
+		}
+		return true;
+	}
+	bool parse_hex4(unsigned long &cp) {
+		if (pos + 4 > text.size())
+			return true;
+		std::string hex(text.substr(pos, 4));
+		char *end;
+		cp = std::strtoul(hex.c_str(), &end, 16);
+		pos += 4;
+		return end != hex.c_str() + 4;
+	}
+	void append_utf8(std::string &out, unsigned long cp) {
+		if (cp < 0x80) {
+			out.push_back(static_cast<char>(cp));
+		} else if (cp < 0x800) {
+			out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+		} else if (cp < 0x10000) {
+			out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+		} else {
+			out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+			out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+			out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+		}
+	}
+};
+
+bool parse_json(const std::string &text, json_value &out) {
+	out = json_value();
+	json_parser p(text);
+	return p.parse(out);
+}
+std::string json_str(const std::string &str) {
+	std::string res("\"");
+	for (char c : str) {
+		switch (c) {
+		case '"': res += "\\\""; break;
+		case '\\': res += "\\\\"; break;
+		case '\n': res += "\\n"; break;
+		case '\r': res += "\\r"; break;
+		case '\t': res += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				res += buf;
+			} else {
+				res.push_back(c);
+			}
+			break;
+		}
+	}
+	res.push_back('"');
+	return res;
+}
@@ -0,0 +1,25 @@
+#ifndef __JSON_HPP__
+#define __JSON_HPP__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class json_value {
+public:
+	enum type_t { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+	type_t type = NUL;
+	bool boolean = false;
+	double number = 0;
+	std::string str;
+	std::vector<json_value> arr;
+	std::vector<std::pair<std::string, json_value>> obj;
+
+	const json_value &operator[](const std::string &key) const; // null value when missing
+};
+
+bool parse_json(const std::string &text, json_value &out);
+std::string json_str(const std::string &str);
+
+#endif
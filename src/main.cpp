@@ -1,12 +1,54 @@
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include "cache.hpp"
 #include "cfg.hpp"
+#include "daemon.hpp"
 #include "formatted_out.hpp"
 #include "project.hpp"
 #include "project_utils.hpp"
+#include "remote.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include "watcher.hpp"
 
 constexpr const char *c_cpp_extension_cfg = "./.vscode/c_cpp_properties.json";
 
 bool verbose;
+bool time_report = false;
+uint64_t memory_limit = 0;
+bool keep_going;
+std::string cache_dir;
+uint64_t cache_size;
+std::string remote_cache_url;
+bool remote_read_only;
+int remote_timeout;
+bool use_pch;
+
+struct options {
+	bool clean = false;
+	bool build = false;
+	bool run = false;
+	bool watch = false;
+	bool daemon = false;
+	bool release = false;
+	bool obfuscate = false;
+};
+// options besides the configuration that change what a build does or produces
+struct build_settings {
+	bool time_report;
+	bool use_pch;
+	std::string cache_dir;
+	uint64_t cache_size;
+	std::string remote_cache_url;
+	bool remote_read_only;
+	int remote_timeout;
+
+	bool operator==(const build_settings &) const = default;
+};
+build_settings current_build_settings() {
+	return { time_report, use_pch, cache_dir, cache_size, remote_cache_url, remote_read_only, remote_timeout };
+}
 
 void showHelp() {
 	std::cout <<
@@ -17,11 +59,25 @@ void showHelp() {
 		"\t\tbuild - builds the project\n" <<
 		"\t\trun - builds and runs the project\n" <<
 		"\t\torun - runs the last build of project\n" <<
+		"\t\twatch - builds the project whenever its sources change\n" <<
+		"\t\tdaemon - keeps the project loaded and builds it for build and run in the project's directory\n" <<
 		"\toptions:\n" <<
 		"\t\t-c    --clean - cleans build files and project libraries before building\n" <<
+		"\t\t-k    --keep-going - keeps building after a command failed (default when not run in a terminal)\n" <<
 		"\t\t-o    --obfuscate - only with release builds, makes the code harder to decompile (unstable!)\n" <<
 		"\t\t-r    --release - enables optimizations, disables debug info\n" <<
-		"\t\t-v    --verbose - shows extra info" <<
+		"\t\t-v    --verbose - shows extra info\n" <<
+		"\t\t      --cache-dir=<dir> - object cache shared by all projects (default: ~/.cache/pyruvic)\n" <<
+		"\t\t      --cache-size=<MiB> - size of the object cache, least recently used objects are evicted (default: 5120)\n" <<
+		"\t\t      --fail-fast - stops the build at the first failed command (default when run in a terminal)\n" <<
+		"\t\t      --memory-limit=<MiB> - memory the parallel jobs may use together (default: available memory)\n" <<
+		"\t\t      --no-cache - compiles without the object cache\n" <<
+		"\t\t      --no-pch - doesn't precompile the headers most sources start with\n" <<
+		"\t\t      --remote-cache=<url> - http:// url of a remote cache in Bazel's layout, e.g. bazel-remote (default: $PYRUVIC_REMOTE_CACHE)\n" <<
+		"\t\t      --remote-read-only - only downloads from the remote cache\n" <<
+		"\t\t      --remote-timeout=<ms> - requests to the remote cache that take longer build locally (default: 5000)\n" <<
+		"\t\t      --time-report - compiles with clang's -ftime-trace and reports the most expensive headers, templates and functions\n" <<
+		"\t\t      --trace=<file> - writes a chrome trace (chrome://tracing, ui.perfetto.dev) of the build\n" <<
 		"\t\t      --version - shows version\n" <<
 		"\t\t      --vscode-ext - updates include paths for the ms-vscode.cpptools extension for vscode" << std::endl;
 }
@@ -30,43 +86,89 @@ void printVersion() {
 		__PYRUVIC_VERSION_PATCH << "." << __PYRUVIC_VERSION_TWEAK << " " << __PYRUVIC_VERSION_NAME << std::endl;
 }
 
-int main(int argc, char **argv) {
-	if (argc == 1) {
-		showHelp();
-		return 0;
-	}
-	bool clean, build, run;
-	bool release, obfuscate;
-	verbose = clean = build = run = release = obfuscate = false;
-	load_cfg();
-	for (int i = 1; i < argc; ++i) {
-		std::string arg(argv[i]);
+// sets the global options too, true when the action is already done
+bool parse_args(const std::vector<std::string> &args, options &opts, int &exit_code) {
+	opts = options();
+	verbose = time_report = false;
+	memory_limit = 0;
+	cache_dir = default_cache_dir();
+	cache_size = default_cache_size;
+	const char *remote_env = getenv("PYRUVIC_REMOTE_CACHE");
+	remote_cache_url = remote_env ? remote_env : "";
+	remote_read_only = false;
+	remote_timeout = default_remote_timeout;
+	use_pch = true;
+	keep_going = !is_interactive();
+	trace_enable("");
+	for (size_t i = 0; i < args.size(); ++i) {
+		const std::string &arg(args[i]);
 		if (arg == "help") {
 			showHelp();
-			return 0;
+			exit_code = 0;
+			return true;
 		} else if (arg == "new") {
-			if (++i >= argc) {
+			if (++i >= args.size()) {
 				std::cout << prettyErrorGeneral("Expected project name", severity::ERROR) << std::endl;
-				return -1;
+				exit_code = -1;
+				return true;
 			}
-			new_project(std::string(argv[i]));
-			return 0;
+			new_project(args[i]);
+			exit_code = 0;
+			return true;
 		} else if (arg == "build") {
-			build = true;
+			opts.build = true;
 		} else if (arg == "run") {
-			build = run = true;
+			opts.build = opts.run = true;
 		} else if (arg == "orun") {
-			run = true;
+			opts.run = true;
+		} else if (arg == "watch") {
+			opts.watch = true;
+		} else if (arg == "daemon") {
+			opts.daemon = true;
 		} else if (arg.starts_with('-')) {
 			if (arg.size() > 1 && arg[1] == '-') {
 				if (arg == "--release") {
-					release = true;
+					opts.release = true;
 				} else if (arg == "--obfuscate") {
-					obfuscate = true;
+					opts.obfuscate = true;
 				} else if (arg == "--clean") {
-					clean = true;
+					opts.clean = true;
+				} else if (arg == "--keep-going") {
+					keep_going = true;
+				} else if (arg == "--fail-fast") {
+					keep_going = false;
 				} else if (arg == "--verbose") {
 					verbose = true;
+				} else if (arg.starts_with("--memory-limit=")) {
+					memory_limit = std::strtoull(arg.c_str() + 15, nullptr, 10) * 1024;
+					if (memory_limit == 0)
+						std::cout << prettyErrorGeneral("Invalid memory limit \"" + arg.substr(15) + "\"", severity::ERROR) << std::endl;
+				} else if (arg.starts_with("--cache-dir=")) {
+					cache_dir = arg.substr(12);
+				} else if (arg.starts_with("--cache-size=")) {
+					cache_size = std::strtoull(arg.c_str() + 13, nullptr, 10) * 1024 * 1024;
+					if (cache_size == 0) {
+						std::cout << prettyErrorGeneral("Invalid cache size \"" + arg.substr(13) + "\"", severity::ERROR) << std::endl;
+						cache_size = default_cache_size;
+					}
+				} else if (arg == "--no-cache") {
+					cache_dir.clear();
+				} else if (arg == "--no-pch") {
+					use_pch = false;
+				} else if (arg.starts_with("--remote-cache=")) {
+					remote_cache_url = arg.substr(15);
+				} else if (arg == "--remote-read-only") {
+					remote_read_only = true;
+				} else if (arg.starts_with("--remote-timeout=")) {
+					remote_timeout = std::atoi(arg.c_str() + 17);
+					if (remote_timeout <= 0) {
+						std::cout << prettyErrorGeneral("Invalid remote timeout \"" + arg.substr(17) + "\"", severity::ERROR) << std::endl;
+						remote_timeout = default_remote_timeout;
+					}
+				} else if (arg == "--time-report") {
+					time_report = true;
+				} else if (arg.starts_with("--trace=")) {
+					trace_enable(arg.substr(8));
 				} else if (arg == "--version") {
 					printVersion();
 				}  else if (arg == "--vscode-ext") {
@@ -78,9 +180,10 @@ int main(int argc, char **argv) {
 			} else {
 				for (unsigned int j = 1; j < arg.size(); ++j) {
 					switch (arg[j]) {
-					case 'r': release = true; break;
-					case 'o': obfuscate = true; break;
-					case 'c': clean = true; break;
+					case 'r': opts.release = true; break;
+					case 'o': opts.obfuscate = true; break;
+					case 'c': opts.clean = true; break;
+					case 'k': keep_going = true; break;
 					case 'v': verbose = true; break;
 					default:
 						std::cout << prettyErrorGeneral(std::string("Unknown switch -") + arg[j], severity::ERROR) << std::endl;
@@ -92,17 +195,126 @@ int main(int argc, char **argv) {
 			std::cout << prettyErrorGeneral("Unknown action \"" + arg + "\"", severity::ERROR) << std::endl;
 		}
 	}
+	return false;
+}
+// serves builds from a resident project - unchanged sources and options are answered without building
+int run_daemon() {
+	if (load_cfg())
+		return -1;
+	std::string cfg_file(pyruvic_path + "/pyruvic.cfg");
+	std::error_code ec;
+	auto cfg_time = std::filesystem::last_write_time(cfg_file, ec);
+	file_watcher watcher;
+	if (watcher.init()) {
+		std::cout << prettyErrorGeneral("could not watch ./src/ for changes", severity::ERROR) << std::endl;
+		return -1;
+	}
+	std::unique_ptr<project> proj;
+	options last;
+	build_settings last_settings;
+	bool dirty = true;
+	bool failed = serve_daemon([&](const std::vector<std::string> &args, std::string &target) {
+		options opts;
+		int exit_code;
+		if (parse_args(args, opts, exit_code))
+			return exit_code;
+		std::error_code ec;
+		auto t = std::filesystem::last_write_time(cfg_file, ec);
+		if (t != cfg_time) {
+			// errors go to the client, the daemon keeps running and loads the config again on the next request
+			proj.reset();
+			if (load_cfg())
+				return -1;
+			cfg_time = t;
+		}
+		for (const auto &file : watcher.wait(0)) {
+			if (!proj || !proj->produced_by_build(file))
+				dirty = true;
+		}
+		// a resident project keeps the configuration and the caches it was loaded with
+		if (!proj || opts.clean || opts.release != last.release || opts.obfuscate != last.obfuscate || current_build_settings() != last_settings) {
+			proj = std::make_unique<project>();
+			if (opts.clean)
+				proj->clean_build_files();
+			if (proj->load(opts.release, opts.obfuscate)) {
+				proj.reset();
+				return -1;
+			}
+		} else if (!dirty && !proj->has_unconditional_commands() && proj->outputs_exist() && !programs_changed() && !trace_enabled()) {
+			std::cout << prettyErrorGeneral(proj->info.name + " is up to date", severity::INFO) << std::endl;
+			target = proj->target_file();
+			return 0;
+		} else if (proj->reload()) {
+			proj.reset();
+			return -1;
+		}
+		last = opts;
+		last_settings = current_build_settings();
+		proj->pre_build();
+		proj->build(opts.release, opts.obfuscate);
+		proj->post_build();
+		bool failed = proj->execute();
+		if (trace_write()) {
+			std::cout << prettyErrorGeneral("failed writing trace", severity::ERROR) << std::endl;
+		}
+		dirty = failed;
+		for (const auto &file : watcher.wait(0)) {
+			if (!proj->produced_by_build(file))
+				dirty = true;
+		}
+		target = proj->target_file();
+		return failed ? -1 : 0;
+	});
+	return failed ? -1 : 0;
+}
+int main(int argc, char **argv) {
+	if (argc == 1) {
+		showHelp();
+		return 0;
+	}
+	std::vector<std::string> args(argv + 1, argv + argc);
+	options opts;
+	int exit_code;
+	if (parse_args(args, opts, exit_code))
+		return exit_code;
+	if (opts.daemon)
+		return run_daemon();
+	if (opts.build && !opts.watch) {
+		std::string target;
+		if (forward_to_daemon(args, exit_code, target)) {
+			if (exit_code == 0 && opts.run && !target.empty())
+				system(target.c_str());
+			return exit_code;
+		}
+	}
+	if (load_cfg())
+		return -1;
 	project proj;
-	if (clean) {
+	if (opts.clean) {
 		proj.clean_build_files();
 	}
-	proj.load(release, obfuscate);
+	if (opts.watch) {
+		proj.watch(opts.release, opts.obfuscate);
+		if (trace_write()) {
+			std::cout << prettyErrorGeneral("failed writing trace", severity::ERROR) << std::endl;
+		}
+		return 0;
+	}
+	if (proj.load(opts.release, opts.obfuscate))
+		return -1;
 	proj.pre_build();
-	if (build) {
-		proj.build(release, obfuscate);
+	if (opts.build) {
+		proj.build(opts.release, opts.obfuscate);
 	}
 	proj.post_build();
-	if (run) {
+	bool failed = proj.execute();
+	if (trace_write()) {
+		std::cout << prettyErrorGeneral("failed writing trace", severity::ERROR) << std::endl;
+	}
+	if (failed) {
+		return -1;
+	}
+	if (opts.run) {
 		proj.run();
 	}
 	return 0;
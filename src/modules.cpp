@@ -0,0 +1,204 @@
+#include "modules.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include "hash.hpp"
+#include "json.hpp"
+#include "process.hpp"
+#include "runtime_config.hpp"
+#include "util.hpp"
+
+#if defined(__linux__)
+constexpr const char *null_device = "/dev/null";
+#elif defined(_WIN32)
+constexpr const char *null_device = "NUL";
+#endif
+
+// by compiler, empty without one - with the identity of the compiler, which is asked again when it changes
+std::map<std::string, std::pair<uint64_t, std::string>> module_scanners;
+std::mutex module_scanners_mutex;
+
+bool modules_enabled(const std::string &cpp_standard) {
+	// c++20, c++2a, gnu++23, c++2b, c++26...
+	size_t ver = cpp_standard.find("++");
+	return ver != std::string::npos && cpp_standard.compare(ver + 2, 1, "2") == 0;
+}
+bool is_module_interface_file(const std::string &file) {
+	return file.ends_with(".cppm") || file.ends_with(".ixx");
+}
+
+// clang-scan-deps next to clang or in PATH, gcc scans itself since gcc 14
+std::string module_scanner(const std::string &compiler) {
+	uint64_t identity = program_identity(compiler);
+	std::lock_guard<std::mutex> lock(module_scanners_mutex);
+	auto it = module_scanners.find(compiler);
+	if (it != module_scanners.end() && it->second.first == identity)
+		return it->second.second;
+	std::string scanner;
+	if (is_clang(compiler)) {
+		std::filesystem::path beside(std::filesystem::path(compiler).parent_path() / "clang-scan-deps");
+		if (beside.has_parent_path() && command_exists(beside.string()))
+			scanner = beside.string();
+		else if (command_exists("clang-scan-deps"))
+			scanner = "clang-scan-deps";
+	} else {
+		process_result res(run_process({ compiler, "-std=c++20", "-fmodules-ts", "-E", "-x", "c++", null_device, "-o", null_device,
+			"-MD", "-MF", null_device, "-fdeps-format=p1689r5", std::string("-fdeps-file=") + null_device, "-fdeps-target=scan.o" }));
+		if (res.exit_code == 0)
+			scanner = compiler;
+	}
+	module_scanners[compiler] = { identity, scanner };
+	return scanner;
+}
+std::vector<std::string> module_scan_command(const std::vector<std::string> &options, const std::string &source, const std::string &objfile, const std::string &ddifile) {
+	std::vector<std::string> cmd;
+	if (options.empty())
+		return cmd;
+	std::string scanner(module_scanner(options[0]));
+	if (scanner.empty())
+		return cmd;
+	bool interface = is_module_interface_file(source);
+	if (is_clang(options[0])) {
+		// prints the dependencies
+		cmd = { scanner, "-format=p1689", "--" };
+		cmd.insert(cmd.end(), options.begin(), options.end());
+		if (interface)
+			cmd.insert(cmd.end(), { "-x", "c++-module" });
+		cmd.insert(cmd.end(), { "-c", source, "-o", objfile });
+	} else {
+		cmd = options;
+		cmd.insert(cmd.end(), { "-fmodules-ts", "-E", "-MD", "-MF", null_device, "-o", null_device,
+			"-fdeps-format=p1689r5", "-fdeps-file=" + ddifile, "-fdeps-target=" + objfile });
+		if (interface)
+			cmd.insert(cmd.end(), { "-x", "c++" });
+		cmd.push_back(source);
+	}
+	return cmd;
+}
+uint64_t module_scan_fingerprint(const std::vector<std::string> &scancmd) {
+	return scancmd.empty() ? hash_string("module declarations") : command_fingerprint(scancmd);
+}
+
+// "name" or "name:partition" of a declaration, partitions of the own module start with ':'
+std::string module_name(const std::string &decl, const std::string &own) {
+	std::string name;
+	for (char c : decl) {
+		if (c == ';')
+			break;
+		if (c != ' ' && c != '\t')
+			name.push_back(c);
+	}
+	bool valid = !name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == ':'; });
+	if (!valid)
+		return "";
+	if (name.starts_with(':'))
+		return own.empty() ? "" : own.substr(0, own.find(':')) + name;
+	return name;
+}
+// keyword followed by a name, e.g. "import" in "import foo;" but not in "import_x();"
+bool starts_declaration(const std::string &code, const std::string &keyword) {
+	return code.starts_with(keyword) && code.size() > keyword.size() && (code[keyword.size()] == ' ' || code[keyword.size()] == '\t' ||
+		code[keyword.size()] == ':' || code[keyword.size()] == ';') && code.ends_with(';');
+}
+module_deps read_module_declarations(const std::string &source) {
+	// without preprocessing - declarations inside #if are taken either way
+	module_deps deps;
+	std::string own;
+	for_each_code_line(source, [&deps, &own](const std::string &line) {
+		std::string code(line);
+		bool exported = starts_declaration(code, "export");
+		if (exported)
+			code = code.substr(code.find_first_not_of(" \t", 6));
+		if (starts_declaration(code, "module")) {
+			std::string name(module_name(code.substr(6), ""));
+			if (name.empty()) // global module fragment or "module :private;"
+				return true;
+			own = name;
+			if (exported || name.find(':') != std::string::npos)
+				deps.provides = name;
+			else
+				deps.imports.push_back(name);
+		} else if (starts_declaration(code, "import")) {
+			std::string name(module_name(code.substr(6), own));
+			if (!name.empty() && std::find(deps.imports.begin(), deps.imports.end(), name) == deps.imports.end())
+				deps.imports.push_back(name);
+		}
+		return true;
+	});
+	return deps;
+}
+bool write_p1689(const std::string &file, const std::string &objfile, const module_deps &deps) {
+	std::string text("{\"version\":1,\"revision\":0,\"rules\":[{\"primary-output\":" + json_str(objfile));
+	if (!deps.provides.empty())
+		text += ",\"provides\":[{\"logical-name\":" + json_str(deps.provides) + ",\"is-interface\":true}]";
+	text += ",\"requires\":[";
+	for (size_t i = 0; i < deps.imports.size(); ++i)
+		text += (i ? ",{\"logical-name\":" : "{\"logical-name\":") + json_str(deps.imports[i]) + "}";
+	text += "]}]}\n";
+	return !replace_file(file, text);
+}
+bool read_p1689(const std::string &file, module_deps &deps) {
+	std::string text;
+	json_value ddi;
+	if (!read_file(file, text) || parse_json(text, ddi) || ddi["rules"].arr.size() != 1)
+		return false;
+	const json_value &rule = ddi["rules"].arr[0];
+	deps = module_deps();
+	if (!rule["provides"].arr.empty())
+		deps.provides = rule["provides"].arr[0]["logical-name"].str;
+	for (const auto &req : rule["requires"].arr) {
+		// header units are looked up by path
+		if (req["lookup-method"].type == json_value::NUL && !req["logical-name"].str.empty())
+			deps.imports.push_back(req["logical-name"].str);
+	}
+	return true;
+}
+bool scan_module_deps(const std::vector<std::string> &scancmd, const std::string &source, const std::string &objfile, const std::string &ddifile, module_deps &deps) {
+	if (!scancmd.empty()) {
+		std::error_code ec;
+		std::filesystem::remove(ddifile, ec);
+		process_result res(run_process(scancmd));
+		// clang-scan-deps prints what gcc writes to the -fdeps-file
+		if (res.exit_code == 0 && !std::filesystem::exists(ddifile) && !replace_file(ddifile, res.out))
+			res.exit_code = -1;
+		if (res.exit_code == 0 && read_p1689(ddifile, deps))
+			return true;
+	}
+	deps = read_module_declarations(source);
+	write_p1689(ddifile, objfile, deps);
+	// a compiler without a scanner only ever gets the declarations
+	return scancmd.empty();
+}
+std::string bmi_file(const std::string &compiler, const std::string &dir, const std::string &module) {
+	std::string name(module);
+	std::replace(name.begin(), name.end(), ':', '-');
+	return dir + name + (is_clang(compiler) ? ".pcm" : ".gcm");
+}
+std::vector<std::string> module_flags(const std::string &compiler, const std::string &source, const std::string &bmi_dir,
+	const module_deps &deps, const std::vector<std::string> &all_imports, const std::string &mapfile) {
+	std::vector<std::string> flags;
+	bool interface = is_module_interface_file(source);
+	if (is_clang(compiler)) {
+		if (!deps.provides.empty())
+			flags.push_back("-fmodule-output=" + bmi_file(compiler, bmi_dir, deps.provides));
+		for (const auto &m : all_imports)
+			flags.push_back("-fmodule-file=" + m + "=" + bmi_file(compiler, bmi_dir, m));
+		if (interface)
+			flags.insert(flags.end(), { "-x", "c++-module" });
+		return flags;
+	}
+	std::string map;
+	if (!deps.provides.empty())
+		map += deps.provides + " " + bmi_file(compiler, bmi_dir, deps.provides) + "\n";
+	for (const auto &m : all_imports)
+		map += m + " " + bmi_file(compiler, bmi_dir, m) + "\n";
+	std::string current;
+	if (!read_file(mapfile, current) || current != map)
+		replace_file(mapfile, map);
+	flags.insert(flags.end(), { "-fmodules-ts", "-fmodule-mapper=" + mapfile });
+	if (interface)
+		flags.insert(flags.end(), { "-x", "c++" });
+	return flags;
+}
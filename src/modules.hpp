@@ -0,0 +1,35 @@
+#ifndef __MODULES_HPP__
+#define __MODULES_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// c++20 named modules - what a source provides and imports decides the order of the compiles
+// (header units aren't supported)
+struct module_deps {
+	std::string provides; // module or partition of an interface unit, empty for other sources
+	std::vector<std::string> imports; // an implementation unit imports its interface
+};
+
+// c++20 and later
+bool modules_enabled(const std::string &cpp_standard);
+// .cppm and .ixx
+bool is_module_interface_file(const std::string &file);
+// command writing the P1689 dependencies of the compile to ddifile - clang-scan-deps or gcc's -fdeps-format,
+// empty when the compiler has no scanner (found out once per compiler version)
+std::vector<std::string> module_scan_command(const std::vector<std::string> &options, const std::string &source, const std::string &objfile, const std::string &ddifile);
+// identifies the scanner, a source is scanned again when it or this changes
+uint64_t module_scan_fingerprint(const std::vector<std::string> &scancmd);
+// runs the scan, sources it fails on and compilers without a scanner fall back to reading the module declarations
+// ddifile is written either way, false when the scanner failed (or was terminated) and the declarations were read instead
+bool scan_module_deps(const std::vector<std::string> &scancmd, const std::string &source, const std::string &objfile, const std::string &ddifile, module_deps &deps);
+bool read_p1689(const std::string &file, module_deps &deps);
+// where the compiled interface (BMI) of the module is kept in dir
+std::string bmi_file(const std::string &compiler, const std::string &dir, const std::string &module);
+// flags of a compile providing and importing these modules (every import, also indirect ones)
+// gcc reads them from a module mapper, written to mapfile when its content changed
+std::vector<std::string> module_flags(const std::string &compiler, const std::string &source, const std::string &bmi_dir,
+	const module_deps &deps, const std::vector<std::string> &all_imports, const std::string &mapfile);
+
+#endif
@@ -0,0 +1,127 @@
+#include "pch.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include "scan.hpp"
+#include "util.hpp"
+
+// project headers changed within this many builds are left out, adding one later rebuilds everything that uses the prefix
+constexpr uint64_t pch_settle_builds = 5;
+
+// "include <x>" for "#  include <x>"
+std::string directive(const std::string &code) {
+	if (!code.starts_with('#'))
+		return "";
+	size_t start = code.find_first_not_of(" \t", 1);
+	return start == std::string::npos ? "" : code.substr(start);
+}
+bool has_include_guard(const std::string &header) {
+	bool guarded = false;
+	for_each_code_line(header, [&guarded](const std::string &code) {
+		std::string d(directive(code));
+		guarded = d.starts_with("pragma once") || d.starts_with("ifndef");
+		return false;
+	});
+	return guarded;
+}
+bool settled(const std::string &header, const file_history &hist) {
+	auto it = hist.find(header);
+	return it != hist.end() && it->second.builds >= pch_settle_builds && !hist.was_updated(header);
+}
+
+std::vector<std::string> leading_includes(const std::string &source) {
+	std::vector<std::string> headers;
+	std::filesystem::path dir(std::filesystem::path(source).parent_path());
+	for_each_code_line(source, [&headers, &dir](const std::string &code) {
+		std::string d(directive(code));
+		if (!d.starts_with("include"))
+			return false;
+		size_t start = d.find_first_of("<\"", 7);
+		if (start == std::string::npos)
+			return false;
+		size_t end = d.find(d[start] == '<' ? '>' : '"', start + 1);
+		if (end == std::string::npos)
+			return false;
+		std::string name(d.substr(start + 1, end - start - 1));
+		if (d[start] == '<') {
+			headers.push_back("<" + name + ">");
+			return true;
+		}
+		// only headers of the project are known to be found next to the source
+		std::string header("./" + (dir / name).lexically_normal().string());
+		if (!stat_file(header).exists)
+			return false;
+		headers.push_back(header);
+		return true;
+	});
+	return headers;
+}
+std::vector<std::string> select_prefix_headers(const std::map<std::string, std::vector<std::string>> &leading, const std::vector<std::string> &previous,
+	size_t min_sources, const file_history &hist, std::set<std::string> &users) {
+	std::map<std::string, std::set<std::string>> includers;
+	for (const auto &source : leading) {
+		for (const auto &h : source.second)
+			includers[h].insert(source.first);
+	}
+	std::vector<std::string> others;
+	for (const auto &i : includers) {
+		if (std::find(previous.begin(), previous.end(), i.first) == previous.end())
+			others.push_back(i.first);
+	}
+	std::stable_sort(others.begin(), others.end(), [&includers](const std::string &a, const std::string &b) {
+		return includers.at(a).size() > includers.at(b).size();
+	});
+	// greedily, as long as enough sources include every chosen header
+	std::vector<std::string> chosen;
+	users.clear();
+	auto consider = [&](const std::string &h, bool kept) {
+		auto it = includers.find(h);
+		if (it == includers.end() || it->second.size() < min_sources)
+			return;
+		if (!h.starts_with('<') && (!has_include_guard(h) || (!kept && !settled(h, hist))))
+			return;
+		std::set<std::string> remaining;
+		for (const auto &s : chosen.empty() ? it->second : users) {
+			if (it->second.contains(s))
+				remaining.insert(s);
+		}
+		if (remaining.size() < min_sources)
+			return;
+		chosen.push_back(h);
+		users = std::move(remaining);
+	};
+	for (const auto &h : previous)
+		consider(h, true);
+	for (const auto &h : others)
+		consider(h, false);
+	return chosen;
+}
+std::vector<std::string> read_prefix_header(const std::string &file) {
+	std::vector<std::string> headers;
+	std::filesystem::path dir(std::filesystem::path(file).parent_path());
+	for_each_code_line(file, [&headers, &dir](const std::string &code) {
+		std::string d(directive(code));
+		if (d.starts_with("include <"))
+			headers.push_back(d.substr(8));
+		else if (d.starts_with("include \"") && d.size() > 10)
+			headers.push_back("./" + (dir / d.substr(9, d.size() - 10)).lexically_normal().string());
+		return true;
+	});
+	return headers;
+}
+bool write_prefix_header(const std::string &file, const std::vector<std::string> &headers) {
+	std::filesystem::path dir(std::filesystem::path(file).parent_path().lexically_normal());
+	std::string text("// generated by pyruvic - the headers most sources include first, precompiled\n");
+	for (const auto &h : headers) {
+		if (h.starts_with('<'))
+			text += "#include " + h + "\n";
+		else
+			text += "#include \"" + std::filesystem::path(h).lexically_normal().lexically_relative(dir).string() + "\"\n";
+	}
+	std::string current;
+	if (read_file(file, current) && current == text)
+		return false;
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	return !replace_file(file, text);
+}
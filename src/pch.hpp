@@ -0,0 +1,26 @@
+#ifndef __PCH_HPP__
+#define __PCH_HPP__
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "runtime_config.hpp"
+
+// a prefix header with the headers most sources start with, precompiled once per configuration and included first
+// headers are "<name>" for system headers and ./src/ paths for project headers
+constexpr size_t pch_min_sources = 4;
+
+// the includes at the top of the source, before any other code or directive
+std::vector<std::string> leading_includes(const std::string &source);
+// headers that at least min_sources of the sources include at their top, with the sources that include all of them
+// headers of the previous prefix are kept first, project headers without include guards or that changed in the last builds
+// of the history aren't taken
+std::vector<std::string> select_prefix_headers(const std::map<std::string, std::vector<std::string>> &leading, const std::vector<std::string> &previous,
+	size_t min_sources, const file_history &hist, std::set<std::string> &users);
+std::vector<std::string> read_prefix_header(const std::string &file);
+// keeps the file (and its time) when the content is the same, true on error
+bool write_prefix_header(const std::string &file, const std::vector<std::string> &headers);
+
+#endif
@@ -0,0 +1,265 @@
+#include "process.hpp"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+std::vector<std::string> shell_command(const std::string &cmd) {
+#ifdef _WIN32
+	return { "cmd", "/c", cmd };
+#else
+	return { "/bin/sh", "-c", cmd };
+#endif
+}
+std::vector<std::string> split_command(const std::string &cmd) {
+	std::vector<std::string> args;
+	std::stringstream ss(cmd);
+	std::string arg;
+	while (ss >> arg)
+		args.push_back(arg);
+	return args;
+}
+std::string join_command(const std::vector<std::string> &args) {
+	std::string cmd;
+	for (const auto &arg : args) {
+		if (!cmd.empty())
+			cmd.push_back(' ');
+		if (!arg.empty() && arg.find_first_of(" \t\"'\\$`&|;<>()*?") == std::string::npos) {
+			cmd += arg;
+			continue;
+		}
+		cmd.push_back('"');
+		for (char c : arg) {
+			if (c == '"' || c == '\\' || c == '$' || c == '`')
+				cmd.push_back('\\');
+			cmd.push_back(c);
+		}
+		cmd.push_back('"');
+	}
+	return cmd;
+}
+
+#ifndef _WIN32
+constexpr size_t max_tracked_processes = 1024;
+std::array<std::atomic<pid_t>, max_tracked_processes> running_pids{};
+volatile sig_atomic_t interrupted = 0;
+volatile sig_atomic_t terminating = 0; // commands started after terminate_processes are terminated right away
+volatile sig_atomic_t interrupt_seen = 0; // kept when the handler is removed
+struct sigaction prev_sigint;
+struct sigaction prev_sigterm;
+
+size_t track_process(pid_t pid) {
+	for (size_t i = 0; i < running_pids.size(); ++i) {
+		pid_t expected = 0;
+		if (running_pids[i].compare_exchange_strong(expected, pid)) {
+			if (interrupted || terminating)
+				kill(-pid, SIGTERM);
+			return i;
+		}
+	}
+	return running_pids.size();
+}
+void untrack_process(size_t slot) {
+	if (slot < running_pids.size())
+		running_pids[slot] = 0;
+}
+void terminate_processes() {
+	terminating = 1;
+	for (auto &p : running_pids) {
+		pid_t pid = p.load();
+		if (pid > 0)
+			kill(-pid, SIGTERM);
+	}
+}
+void interrupt_processes() {
+	interrupted = 1;
+	interrupt_seen = 1;
+	terminate_processes();
+}
+void interrupt_handler(int) {
+	interrupt_processes();
+}
+void install_interrupt_handler() {
+	clear_interrupt();
+	interrupt_seen = 0;
+	struct sigaction sa{};
+	sa.sa_handler = interrupt_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &prev_sigint);
+	sigaction(SIGTERM, &sa, &prev_sigterm);
+}
+void remove_interrupt_handler() {
+	sigaction(SIGINT, &prev_sigint, nullptr);
+	sigaction(SIGTERM, &prev_sigterm, nullptr);
+	clear_interrupt();
+}
+void clear_interrupt() {
+	interrupted = 0;
+	terminating = 0;
+}
+bool process_interrupted() {
+	return interrupted;
+}
+bool interrupt_received() {
+	return interrupt_seen;
+}
+
+// pipe2 is missing on some systems (macOS)
+int cloexec_pipe(int fds[2]) {
+	if (pipe(fds))
+		return -1;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+}
+process_result run_process(const std::vector<std::string> &args, const std::atomic<bool> *cancel) {
+	process_result res{ 127, "", "", 0, 0, 0 };
+	auto start = std::chrono::steady_clock::now();
+	int out_pipe[2], err_pipe[2];
+	if (cloexec_pipe(out_pipe)) {
+		res.err = "failed to create pipe for " + join_command(args) + "\n";
+		return res;
+	}
+	if (cloexec_pipe(err_pipe)) {
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		res.err = "failed to create pipe for " + join_command(args) + "\n";
+		return res;
+	}
+	std::vector<char *> argv;
+	for (const auto &arg : args)
+		argv.push_back(const_cast<char *>(arg.c_str()));
+	argv.push_back(nullptr);
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+	// own process group, so that the whole command (compiler driver and its children) can be terminated at once
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	// SIGPIPE goes back to default, the daemon ignores it
+	sigset_t sigdefault;
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attr, 0);
+	pid_t pid;
+	int spawn_err = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	close(out_pipe[1]);
+	close(err_pipe[1]);
+	if (spawn_err) {
+		close(out_pipe[0]);
+		close(err_pipe[0]);
+		res.err = "failed to run " + args[0] + ": " + strerror(spawn_err) + "\n";
+		return res;
+	}
+	size_t slot = track_process(pid);
+
+	// closed pipes are dropped from the poll set by making their fd negative
+	std::array<pollfd, 2> fds{ pollfd{ out_pipe[0], POLLIN, 0 }, pollfd{ err_pipe[0], POLLIN, 0 } };
+	std::array<char, 65536> buffer;
+	bool cancelled = false;
+	for (int open_pipes = 2; open_pipes > 0;) {
+		if (cancel && !cancelled && *cancel) {
+			kill(-pid, SIGTERM);
+			cancelled = true;
+		}
+		int n = poll(fds.data(), fds.size(), cancel ? 100 : -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (auto &p : fds) {
+			if (p.fd < 0 || !(p.revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			ssize_t len = read(p.fd, buffer.data(), buffer.size());
+			if (len > 0) {
+				(p.fd == out_pipe[0] ? res.out : res.err).append(buffer.data(), len);
+			} else if (len == 0 || errno != EINTR) {
+				p.fd = -1;
+				--open_pipes;
+			}
+		}
+	}
+	close(out_pipe[0]);
+	close(err_pipe[0]);
+
+	// the pid stays tracked until the child exited, but not after it was reaped and the pid could be reused
+	siginfo_t info;
+	while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) { }
+	untrack_process(slot);
+	int status;
+	rusage usage;
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			res.exit_code = 1;
+			return res;
+		}
+	}
+	res.wall_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	res.cpu_time = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#ifdef __APPLE__
+	res.peak_rss = static_cast<uint64_t>(usage.ru_maxrss) / 1024; // bytes
+#else
+	res.peak_rss = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+	if (WIFEXITED(status))
+		res.exit_code = WEXITSTATUS(status);
+	else
+		res.exit_code = 128 + WTERMSIG(status);
+	return res;
+}
+#else
+void terminate_processes() { }
+void interrupt_processes() { }
+void install_interrupt_handler() { }
+void remove_interrupt_handler() { }
+void clear_interrupt() { }
+bool process_interrupted() {
+	return false;
+}
+bool interrupt_received() {
+	return false;
+}
+
+process_result run_process(const std::vector<std::string> &args, const std::atomic<bool> *) {
+	process_result res{ 1, "", "", 0, 0, 0 };
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::array<char, 4096> buffer;
+		auto pclose_capture = [&res](FILE *stream) { res.exit_code = _pclose(stream); };
+		std::unique_ptr<FILE, decltype(pclose_capture)> pipe(_popen(join_command(args).c_str(), "r"), pclose_capture);
+		if (!pipe) {
+			res.err = "failed to run " + join_command(args) + "\n";
+			return res;
+		}
+		size_t len;
+		while ((len = fread(buffer.data(), 1, buffer.size(), pipe.get())) > 0) {
+			res.out.append(buffer.data(), len);
+		}
+	}
+	res.wall_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	return res;
+}
+#endif
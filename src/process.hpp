@@ -0,0 +1,37 @@
+#ifndef __PROCESS_HPP__
+#define __PROCESS_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct process_result {
+	int exit_code;
+	std::string out;
+	std::string err;
+	uint64_t peak_rss; // KiB, 0 when unknown
+	uint64_t wall_time; // us
+	uint64_t cpu_time; // us, 0 when unknown
+};
+
+std::vector<std::string> shell_command(const std::string &cmd);
+std::vector<std::string> split_command(const std::string &cmd);
+std::string join_command(const std::vector<std::string> &args);
+// the command is terminated once *cancel becomes true
+process_result run_process(const std::vector<std::string> &args, const std::atomic<bool> *cancel=nullptr);
+// sends SIGTERM to the process groups of all running commands and of those started until the stop is cleared
+void terminate_processes();
+// acts like SIGINT arrived - the running build stops
+void interrupt_processes();
+// SIGINT/SIGTERM terminate the running commands instead of leaving them orphaned
+void install_interrupt_handler();
+// also clears the stop, so that commands started afterwards (scans and probes of the next build) run
+void remove_interrupt_handler();
+// ends the stop of an interrupt or terminate_processes - new commands aren't terminated anymore
+void clear_interrupt();
+bool process_interrupted();
+// whether the last build stopped for an interrupt, also after the handler was removed
+bool interrupt_received();
+
+#endif
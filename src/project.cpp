@@ -1,30 +1,111 @@
 #include "project.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <thread>
 #include "cmdutils.hpp"
 #include "formatted_out.hpp"
+#include "hash.hpp"
+#include "jobserver.hpp"
+#include "modules.hpp"
+#include "pch.hpp"
+#include "process.hpp"
+#include "scan.hpp"
+#include "time_report.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+#include "watcher.hpp"
 
 extern bool verbose;
+extern bool time_report;
+extern std::string cache_dir;
+extern uint64_t cache_size;
+extern std::string remote_cache_url;
+extern bool remote_read_only;
+extern int remote_timeout;
+extern bool use_pch;
 
-void project::load(bool release, bool obfuscate) {
+// source files a pre-build command names - it might (re)generate them
+std::vector<std::string> mentioned_sources(const std::string &cmd) {
+	std::vector<std::string> files;
+	std::stringstream ss(cmd);
+	std::string word;
+	while (ss >> word) {
+		word.erase(std::remove(word.begin(), word.end(), '"'), word.end());
+		if (word.starts_with("src/"))
+			word = "./" + word;
+		if (word.starts_with("./src/") && (word.ends_with(".c") || word.ends_with(".cpp")))
+			files.push_back(word);
+	}
+	return files;
+}
+
+// what the link reads - the command, the recorded objects and the libraries
+uint64_t link_inputs(const std::vector<std::string> &linkcmd, const std::vector<std::string> &obj_files, const std::vector<std::string> &libs, const object_history &objhist) {
+	xxh64 h;
+	uint64_t command = command_fingerprint(linkcmd);
+	h.update(&command, sizeof(command));
+	for (const auto &obj : obj_files) {
+		uint64_t stamp = objhist.recorded(obj);
+		h.update(&stamp, sizeof(stamp));
+	}
+	for (const auto &lib : libs) {
+		std::string path(find_library(linkcmd[0], lib));
+		uint64_t content = path.empty() ? 0 : current_stamp(path).hash;
+		h.update(&content, sizeof(content));
+	}
+	return h.digest();
+}
+
+bool project::load(bool release, bool obfuscate) {
+	trace_scope trace("loading project", "config");
+	if (read_project_file())
+		return true;
+	load_state(release, obfuscate);
+	hist_at_load = hist;
+	select_commands();
+	return false;
+}
+bool project::reload() {
+	reset_build();
+	std::error_code ec;
+	if (std::filesystem::last_write_time("./pyruvic.projinfo", ec) != projfile_time && read_project_file())
+		return true;
+	hist_at_load = hist;
+	select_commands();
+	return false;
+}
+bool project::read_project_file() {
 	std::string proj_file("./pyruvic.projinfo");
 	if (!std::filesystem::exists(proj_file)) {
 		std::cout << prettyErrorGeneral("could not find project file - " + proj_file, severity::FATAL) << std::endl;
-		exit(-1);
+		return true;
 	}
 	std::cout << prettyErrorGeneral("loading project file - " + proj_file, severity::INFO) << std::endl;
+	projfile_time = std::filesystem::last_write_time(proj_file);
 	std::ifstream f(proj_file);
 	std::stringstream projfile_ss;
 	projfile_ss << f.rdbuf();
-	tokenstream ts = lex(proj_file, projfile_ss);
-	pyruvic_file proj(parse(ts));
+	tokenstream ts;
+	{
+		trace_scope trace("lexing " + proj_file, "config");
+		ts = lex(proj_file, projfile_ss);
+	}
+	pyruvic_file &proj = projfile;
+	{
+		trace_scope trace("parsing " + proj_file, "config");
+		proj = parse(ts);
+	}
+	info = project_info();
 	bool errors = false;
 	if (proj["[target]"][""][""]["name:"].empty()) { std::cout << prettyErrorGeneral("[target] must have name", severity::ERROR) << std::endl; errors = true; }
 	if (proj["[target]"][""][""]["type:"].empty()) { std::cout << prettyErrorGeneral("[target] must have type", severity::ERROR) << std::endl; errors = true; }
 	if (proj["[target]"][""][""]["macroname:"].empty()) { std::cout << prettyErrorGeneral("[target] must have macroname", severity::ERROR) << std::endl; errors = true; }
 	if (proj["[target]"][""][""]["version:"].empty()) { std::cout << prettyErrorGeneral("[target] must have version", severity::ERROR) << std::endl; errors = true; }
-	if (errors) { exit(-1); }
+	if (errors) { return true; }
 
 	info.name = proj["[target]"][""][""]["name:"][0];
 	const std::string &t = proj["[target]"][""][""]["type:"][0];
@@ -74,31 +155,35 @@ break_version_loop:
 	for (const auto &stdlib : get_val_list_by_platform(proj["[requirements]"][""], "libs:"))
 		info.stdlibs.push_back(stdlib);
 
-	if (errors) { exit(-1); }
-
-	if (std::filesystem::exists(filehist_file))
-		hist.load_saved(filehist_file);
-	if (std::filesystem::exists(filedeps_file))
-		fdeps.load_saved(filedeps_file);
-	if (std::filesystem::exists(last_build_file)) {
-		std::ifstream flb(last_build_file);
-		uint16_t build_data;
-		flb >> build_data;
-		if ((build_data & 1) != release || ((build_data >> 1) & 1) != obfuscate) {
-			hist.clear();
-		}
-	} else {
-		hist.clear(); // rebuild when unknown
-	}
-
-	auto fillcmds = [this](std::vector<std::string> &cmds, subcategory &subc) {
+	return errors;
+}
+void project::load_state(bool release, bool obfuscate) {
+	// switching configurations keeps the objects and state of the others
+	state_dir = config_dir(release, obfuscate);
+	std::filesystem::create_directories(state_dir);
+	if (std::filesystem::exists(state_dir + filehist_file))
+		hist.load_saved(state_dir + filehist_file);
+	if (std::filesystem::exists(state_dir + filedeps_file))
+		fdeps.load_saved(state_dir + filedeps_file);
+	if (std::filesystem::exists(state_dir + jobstats_file))
+		jobhist.load_saved(state_dir + jobstats_file);
+	objhist.load_saved(state_dir + objhist_file);
+	if (cache.init(cache_dir, cache_size))
+		std::cout << prettyErrorGeneral("could not create the object cache in " + cache_dir, severity::WARN) << std::endl;
+	remote.init(remote_cache_url, remote_read_only, remote_timeout);
+}
+void project::select_commands() {
+	// everything up to running the graph reads stats of ./src/ from this scan
+	source_files = scan_tree("./src/");
+	input_state inputs(fdeps, &hist);
+	auto fillcmds = [this, &inputs](std::vector<std::string> &cmds, subcategory &subc) {
 		for (const auto &vp : subc) {
 			if (vp.first.empty() || std::find_if(std::begin(platform_idents), std::end(platform_idents),
 				[&vp](const char *plid) { return vp.first == plid; }) != std::end(platform_idents)) {
 				for (const auto &vl : vp.second) {
 					std::string file(vl.first.substr(0, vl.first.size() - 1));
 					replace_vars(info, file);
-					if (file == "__always__" || hist.was_updated(file, fdeps)) {
+					if (file == "__always__" || inputs.updated(file)) {
 						for (const auto &v : vl.second) {
 							std::string v_copy(v);
 							replace_vars(info, v_copy);
@@ -112,13 +197,13 @@ break_version_loop:
 			}
 		}
 	};
-	category &commands = proj["[commands]"];
+	category &commands = projfile["[commands]"];
 	fillcmds(prebuild_commands, commands["pre-build"]);
 	fillcmds(prebuild_parallel_commands, commands["pre-build-parallel"]);
 	fillcmds(postbuild_commands, commands["post-build"]);
 	fillcmds(postbuild_parallel_commands, commands["post-build-parallel"]);
 
-	subcategory &dependencies = proj["[dependencies]"][""];
+	subcategory &dependencies = projfile["[dependencies]"][""];
 	for (const auto &vp : dependencies) {
 		if (vp.first.empty() || std::find_if(std::begin(platform_idents), std::end(platform_idents),
 			[&vp](const char *pi){ return pi == vp.first; })) {
@@ -133,14 +218,18 @@ void project::clean_build_files() const {
 	std::filesystem::remove_all("./.pyr/");
 }
 void project::pre_build() {
-	if (!prebuild_commands.empty())
-		run_commands(prebuild_commands, info.name + " pre-build commands");
-	if (!prebuild_parallel_commands.empty())
-		run_commands_parallel(prebuild_parallel_commands, info.name + " pre-build commands (parallel)");
+	// serial commands keep their order, parallel ones wait for the serial ones
+	std::vector<size_t> serial_dep;
+	for (const auto &cmd : prebuild_commands) {
+		size_t n = graph.add({ .args = shell_command(cmd), .deps = serial_dep });
+		serial_dep = { n };
+		prebuild_nodes.push_back(n);
+	}
+	for (const auto &cmd : prebuild_parallel_commands)
+		prebuild_nodes.push_back(graph.add({ .args = shell_command(cmd), .deps = serial_dep }));
 
-	if (!info.cfg_file.empty() && hist.was_updated("./pyruvic.projinfo")) {
+	if (!info.cfg_file.empty() && (hist.was_updated("./pyruvic.projinfo") || !std::filesystem::exists(info.cfg_file))) {
 		std::string template_file(pyruvic_path + "/pyruvic-default-cfg-format.cfg");
-		std::cout << prettyErrorGeneral("configuring " + info.cfg_file, severity::INFO) << std::endl;
 		std::stringstream template_ss;
 		{
 			std::ifstream f(template_file);
@@ -148,117 +237,627 @@ void project::pre_build() {
 		}
 		std::string templ(template_ss.str());
 		replace_vars(info, templ);
-		std::ofstream fw(info.cfg_file);
-		fw << templ;
+		// an unchanged file keeps its time, edits to the project file that don't show up in it change nothing
+		std::stringstream current_ss;
+		{
+			std::ifstream f(info.cfg_file);
+			current_ss << f.rdbuf();
+		}
+		if (current_ss.str() != templ) {
+			std::cout << prettyErrorGeneral("configuring " + info.cfg_file, severity::INFO) << std::endl;
+			std::ofstream fw(info.cfg_file);
+			fw << templ;
+			forget_scanned(("./" / std::filesystem::path(info.cfg_file).lexically_normal()).string());
+		}
 	}
 }
 void project::build(bool release, bool obfuscate) {
 	// TODO: libraries
 
-	std::string compile_options("-Wall ");
-	std::string c_compile_options("");
-	std::string cpp_compile_options("");
-	std::string link_options("");
+	std::vector<std::string> compile_options{ "-Wall" };
+	std::vector<std::string> c_compile_options;
+	std::vector<std::string> cpp_compile_options;
+	std::vector<std::string> link_options;
 	if (release) {
-		compile_options += "-O3 ";
+		compile_options.push_back("-O3");
 		if (obfuscate) {
-			compile_options += "-static -s -fvisibility=hidden -fvisibility-inlines-hidden ";
+			compile_options.insert(compile_options.end(), { "-static", "-s", "-fvisibility=hidden", "-fvisibility-inlines-hidden" });
 		}
 	} else {
-		compile_options += "-Wextra -Wpedantic -g ";
+		compile_options.insert(compile_options.end(), { "-Wextra", "-Wpedantic", "-g" });
 	}
 	if (!info.c_standard.empty()) {
-		c_compile_options += "-std=" + info.c_standard + " ";
+		c_compile_options.push_back("-std=" + info.c_standard);
 	}
 	if (!info.cpp_standard.empty()) {
-		cpp_compile_options += "-std=" + info.cpp_standard + " ";
+		cpp_compile_options.push_back("-std=" + info.cpp_standard);
 	}
 	for (const auto &stdlib : info.stdlibs) {
-		link_options += " -l" + stdlib;
+		link_options.push_back("-l" + stdlib);
 	}
-	std::vector<std::string> obj_files;
-	std::vector<std::string> build_cmds;
-	for (const auto &dir_entry : std::filesystem::recursive_directory_iterator("./src/")) {
-		if (!dir_entry.is_directory()) {
-			std::string file(dir_entry.path().string());
-			bool c_file = file.ends_with(".c");
-			bool cpp_file = file.ends_with(".cpp");
-			bool c_cpp_header_file = c_file || cpp_file || file.ends_with(".h") || file.ends_with(".hpp");
-			bool updated = false;
-			if (hist.was_updated(file)) {
-				if (c_cpp_header_file)
-					fdeps.save_c_cpp_deps(file);
-				updated = true;
-			} else if (hist.was_updated(file, fdeps)) {
-				updated = true;
+	bool c_time_trace = false;
+	bool cpp_time_trace = false;
+	if (time_report) {
+		c_time_trace = is_clang(c_compiler);
+		cpp_time_trace = is_clang(cpp_compiler);
+		if (c_time_trace)
+			c_compile_options.push_back("-ftime-trace");
+		if (cpp_time_trace)
+			cpp_compile_options.push_back("-ftime-trace");
+		if (!c_time_trace && !cpp_time_trace)
+			std::cout << prettyErrorGeneral("compile time report needs clang - " + cpp_compiler + " is used", severity::WARN) << std::endl;
+	}
+	trace_scope trace("scanning sources", "scan");
+	std::vector<std::string> files(source_files);
+	// sources written by pre-build commands are compiled after them (and might not exist yet)
+	for (size_t n : prebuild_nodes) {
+		for (const auto &file : mentioned_sources(graph[n].command_line())) {
+			if (std::find(generated_files.begin(), generated_files.end(), file) == generated_files.end())
+				generated_files.push_back(file);
+			if (std::find(files.begin(), files.end(), file) == files.end())
+				files.push_back(file);
+		}
+	}
+	for (const auto &file : files) {
+		bool c_cpp_header_file = file.ends_with(".c") || file.ends_with(".cpp") || is_module_interface_file(file) || file.ends_with(".h") || file.ends_with(".hpp");
+		if (c_cpp_header_file && hist.was_updated(file))
+			fdeps.save_c_cpp_deps(file);
+	}
+	// sources importing named modules are compiled after the interfaces, which they depend on like on includes
+	std::vector<std::string> cpp_options{ cpp_compiler };
+	cpp_options.insert(cpp_options.end(), compile_options.begin(), compile_options.end());
+	cpp_options.insert(cpp_options.end(), cpp_compile_options.begin(), cpp_compile_options.end());
+	std::map<std::string, module_deps> modules; // of the sources providing or importing one
+	std::map<std::string, std::string> providers; // source of every module
+	if (modules_enabled(info.cpp_standard)) {
+		std::vector<std::string> cpp_sources;
+		for (const auto &file : files) {
+			if ((file.ends_with(".cpp") || is_module_interface_file(file)) && std::find(generated_files.begin(), generated_files.end(), file) == generated_files.end())
+				cpp_sources.push_back(file);
+		}
+		for (auto &m : scan_modules(cpp_sources, cpp_options)) {
+			if (!m.second.provides.empty() || !m.second.imports.empty())
+				modules.insert(std::move(m));
+		}
+		for (const auto &m : modules) {
+			if (m.second.provides.empty())
+				continue;
+			auto added = providers.emplace(m.second.provides, m.first);
+			if (!added.second)
+				std::cout << prettyErrorGeneral("module " + m.second.provides + " is provided by " + added.first->second + " and " + m.first, severity::ERROR) << std::endl;
+		}
+		std::vector<std::string> ordered;
+		std::set<std::string> placed;
+		std::set<std::string> visiting;
+		std::function<void(const std::string &)> place = [&](const std::string &file) {
+			if (placed.contains(file))
+				return;
+			if (!visiting.insert(file).second) {
+				std::cout << prettyErrorGeneral("module imports of " + file + " form a cycle", severity::ERROR) << std::endl;
+				return;
 			}
-			if (c_file || cpp_file) {
-				std::string objfile("./.pyr/objfiles/" + dir_entry.path().filename().replace_extension(objfile_ext).string());
-				if (updated) {
-					if (c_file) {
-						std::string cmd(c_compiler + " " + compile_options + c_compile_options + "-c -o \"" + objfile + "\" \"" + file + "\"");
-						if (verbose)
-							std::cout << prettyErrorGeneral(cmd, severity::DEBUG) << std::endl;
-						build_cmds.push_back(cmd);
-					} else {
-						std::string cmd(cpp_compiler + " " + compile_options + cpp_compile_options + "-c -o \"" + objfile + "\" \"" + file + "\"");
-						if (verbose)
-							std::cout << prettyErrorGeneral(cmd, severity::DEBUG) << std::endl;
-						build_cmds.push_back(cmd);
-					}
+			auto m = modules.find(file);
+			if (m != modules.end()) {
+				for (const auto &imp : m->second.imports) {
+					auto p = providers.find(imp);
+					if (p != providers.end() && p->second != file)
+						place(p->second);
 				}
-				obj_files.push_back(objfile);
 			}
+			visiting.erase(file);
+			placed.insert(file);
+			ordered.push_back(file);
+		};
+		for (const auto &file : files)
+			place(file);
+		files = std::move(ordered);
+	} else if (std::any_of(files.begin(), files.end(), is_module_interface_file)) {
+		std::cout << prettyErrorGeneral("module interface units need c++-standard: c++20 or later", severity::WARN) << std::endl;
+	}
+	// every module a source imports, also through other interfaces, and the sources providing them
+	auto module_imports = [&modules, &providers](const std::string &file, std::vector<std::string> &imports, std::vector<std::string> &sources) {
+		std::vector<std::string> todo(modules.at(file).imports);
+		while (!todo.empty()) {
+			std::string imp(std::move(todo.back()));
+			todo.pop_back();
+			auto p = providers.find(imp);
+			if (p == providers.end() || p->second == file || std::find(imports.begin(), imports.end(), imp) != imports.end())
+				continue;
+			imports.push_back(imp);
+			sources.push_back(p->second);
+			const std::vector<std::string> &next = modules.at(p->second).imports;
+			todo.insert(todo.end(), next.begin(), next.end());
+		}
+	};
+	for (const auto &m : modules) {
+		std::vector<std::string> imports;
+		std::vector<std::string> sources;
+		module_imports(m.first, imports, sources);
+		std::filesystem::path dir(std::filesystem::path(m.first).parent_path());
+		std::vector<std::string> &known = fdeps[m.first];
+		for (const auto &source : sources) {
+			std::string dep(std::filesystem::path(source).lexically_normal().lexically_relative(dir.lexically_normal()).string());
+			if (std::find(known.begin(), known.end(), dep) == known.end())
+				known.push_back(dep);
 		}
 	}
-	for (const auto &dir_entry : std::filesystem::recursive_directory_iterator("./src/")) {
-		if (!dir_entry.is_directory()) {
-			std::string file(dir_entry.path().string());
-			bool c_cpp_header_file = file.ends_with(".c") || file.ends_with(".cpp") || file.ends_with(".h") || file.ends_with(".hpp");
-			if (c_cpp_header_file) {
-				hist.update(file);
+	// the headers most C++ sources start with are compiled once, the sources that start with all of them include it first
+	std::string prefix_file(state_dir + pch_dir + pch_prefix_file);
+	std::string pch_file(prefix_file + (is_clang(cpp_compiler) ? ".pch" : ".gch"));
+	std::set<std::string> pch_users;
+	std::vector<std::string> pch_inputs; // the compiler leaves the precompiled headers out of the depfiles
+	if (use_pch) {
+		std::map<std::string, std::vector<std::string>> leading;
+		for (const auto &file : files) {
+			// a module unit has to start with its module declaration
+			if (file.ends_with(".cpp") && !modules.contains(file) && std::find(generated_files.begin(), generated_files.end(), file) == generated_files.end())
+				leading.emplace(file, leading_includes(file));
+		}
+		size_t min_sources = std::max(pch_min_sources, (leading.size() + 1) / 2);
+		std::vector<std::string> headers(select_prefix_headers(leading, read_prefix_header(prefix_file), min_sources, hist, pch_users));
+		if (headers.empty() || write_prefix_header(prefix_file, headers)) {
+			pch_users.clear();
+		} else {
+			fdeps.save_c_cpp_deps(prefix_file);
+			std::set<std::string> included(fdeps.included_files(prefix_file));
+			pch_inputs.assign(included.begin(), included.end());
+		}
+	}
+	if (pch_users.empty()) {
+		std::error_code ec;
+		std::filesystem::remove_all(state_dir + pch_dir, ec);
+	}
+	std::vector<std::string> pchcmd(cpp_options);
+	pchcmd.insert(pchcmd.end(), { "-x", "c++-header", prefix_file, "-o", pch_file });
+	uint64_t pch_fingerprint = command_fingerprint(pchcmd);
+	auto pch_stamp = [this, prefix_file, pch_fingerprint]() {
+		return object_history::object_stamp(object_history::input_stamp(prefix_file, fdeps), pch_fingerprint);
+	};
+	std::vector<size_t> pch_deps;
+	for (size_t n : prebuild_nodes) {
+		std::string prebuild_cmd(graph[n].command_line());
+		if (std::any_of(pch_inputs.begin(), pch_inputs.end(), [&prebuild_cmd](const std::string &in) { return prebuild_cmd.find(in) != std::string::npos; }))
+			pch_deps.push_back(n);
+	}
+	// built before the compiles that use it, unless it's up to date - they are added after it, their lookups before it
+	// (up to date objects and cache hits don't need it, it isn't built when no user needs it)
+	bool pch_current = pch_deps.empty() && std::filesystem::exists(pch_file) && objhist.recorded(pch_file) == pch_stamp();
+	std::vector<std::shared_ptr<compile_job>> pch_jobs;
+	std::vector<build_graph::node> pch_compiles;
+	std::map<std::string, size_t> module_nodes; // compiles of the interfaces in the graph, by source
+	// an object is rebuilt when it's missing or its inputs or its command changed since it was last built successfully
+	input_state signatures(fdeps);
+	std::vector<std::string> obj_files;
+	std::set<std::filesystem::path> obj_dirs;
+	for (const auto &file : files) {
+		bool c_file = file.ends_with(".c");
+		bool cpp_file = file.ends_with(".cpp") || is_module_interface_file(file);
+		if (c_file || cpp_file) {
+			std::string objfile(object_file(file));
+			obj_dirs.insert(std::filesystem::path(objfile).parent_path());
+			// a compile only waits for the pre-build commands that mention the source or something it includes
+			std::vector<size_t> node_deps;
+			std::set<std::string> inputs(fdeps.included_files(file));
+			inputs.insert(file);
+			for (size_t n : prebuild_nodes) {
+				std::string prebuild_cmd(graph[n].command_line());
+				if (std::any_of(inputs.begin(), inputs.end(), [&prebuild_cmd](const std::string &in) { return prebuild_cmd.find(in) != std::string::npos; }))
+					node_deps.push_back(n);
+			}
+			std::vector<std::string> cmd{ c_file ? c_compiler : cpp_compiler };
+			cmd.insert(cmd.end(), compile_options.begin(), compile_options.end());
+			const std::vector<std::string> &lang_options = c_file ? c_compile_options : cpp_compile_options;
+			cmd.insert(cmd.end(), lang_options.begin(), lang_options.end());
+			auto mod = modules.find(file);
+			std::vector<std::string> mod_sources; // what the compile reads besides includes - the interfaces it imports
+			if (mod != modules.end()) {
+				std::vector<std::string> imports;
+				module_imports(file, imports, mod_sources);
+				std::string mapfile(std::filesystem::path(objfile).replace_extension(".map").string());
+				std::vector<std::string> flags(module_flags(cpp_compiler, file, state_dir + bmi_dir, mod->second, imports, mapfile));
+				cmd.insert(cmd.end(), flags.begin(), flags.end());
+			}
+			bool provides_module = mod != modules.end() && !mod->second.provides.empty();
+			bool uses_pch = pch_users.contains(file);
+			if (uses_pch)
+				cmd.insert(cmd.end(), { "-include", prefix_file });
+			std::string depfile(std::filesystem::path(objfile).replace_extension(".d").string());
+			cmd.insert(cmd.end(), { "-MMD", "-MF", depfile, "-c", "-o", objfile, file });
+			uint64_t fingerprint = command_fingerprint(cmd);
+			auto rec = objhist.find(objfile);
+			bool updated = rec == objhist.end() || !std::filesystem::exists(objfile) ||
+				(provides_module && !std::filesystem::exists(bmi_file(cpp_compiler, state_dir + bmi_dir, mod->second.provides))) ||
+				rec->second != object_history::object_stamp(signatures.signature(file), fingerprint);
+			if (updated || !node_deps.empty()) {
+				if (verbose)
+					std::cout << prettyErrorGeneral(join_command(cmd), severity::DEBUG) << std::endl;
+				std::atomic<bool> *cancel = watching ? &compile_cancel[file] : nullptr;
+				auto job = std::make_shared<compile_job>();
+				job->source = file;
+				compile_jobs.push_back(job);
+				std::vector<size_t> compile_deps(node_deps);
+				for (const auto &source : mod_sources) {
+					auto n = module_nodes.find(source);
+					if (n != module_nodes.end())
+						compile_deps.push_back(n->second);
+				}
+				// outputs of a compile or a cache hit - inputs that changed meanwhile are rebuilt next time
+				auto finish = [this, objfile, depfile, fingerprint, job, uses_pch, prefix_file, mod_sources](bool compiled) {
+					bool unchanged = object_history::input_stamp(job->source, fdeps) == job->stamp;
+					if (unchanged && !job->cache_key.empty()) {
+						if (compiled || job->remote_hit)
+							cache.store(job->cache_key, objfile, depfile);
+						if (compiled)
+							remote.upload("object " + job->cache_key, { objfile, depfile });
+					}
+					// the compiler saw every include, also <...> ones and those behind macros - the stamp covers them too
+					std::vector<std::string> deps;
+					if (file_dependencies::read_depfile(depfile, job->source, deps)) {
+						std::filesystem::path dir(std::filesystem::path(job->source).parent_path());
+						if (uses_pch) {
+							std::string prefix(std::filesystem::path(prefix_file).lexically_normal().lexically_relative(dir.lexically_normal()).string());
+							if (std::find(deps.begin(), deps.end(), prefix) == deps.end())
+								deps.push_back(prefix);
+						}
+						for (const auto &source : mod_sources)
+							deps.push_back(std::filesystem::path(source).lexically_normal().lexically_relative(dir.lexically_normal()).string());
+						// the next lookup of the same command and source can skip the preprocessor
+						if (unchanged && !job->cache_key.empty() && !job->direct_key.empty() && !job->direct_hit)
+							cache.remember(job->direct_key, job->cache_key, job->headers);
+						if (unchanged) {
+							input_state inputs(fdeps);
+							inputs.set_includes(job->source, deps);
+							job->stamp = inputs.signature(job->source);
+						}
+						job->reported_deps = std::move(deps);
+					}
+					objhist.record(objfile, object_history::object_stamp(job->stamp, fingerprint));
+				};
+				// sources regenerated with the same content don't need the compile after all, cached objects don't need it either
+				bool restat = !node_deps.empty();
+				// preprocessing leaves imports as they are and the caches don't keep interfaces - module units always compile
+				bool cacheable = (cache.enabled() || remote.enabled()) && !(c_file ? c_time_trace : cpp_time_trace) && mod == modules.end();
+				std::function<bool()> up_to_date = nullptr;
+				if (restat || cacheable) {
+					up_to_date = [this, cmd, objfile, depfile, fingerprint, job, restat, cacheable, finish]() {
+						if (restat && std::filesystem::exists(objfile) &&
+							objhist.recorded(objfile) == object_history::object_stamp(object_history::input_stamp(job->source, fdeps), fingerprint))
+							return true;
+						if (!cacheable)
+							return false;
+						job->stamp = object_history::input_stamp(job->source, fdeps);
+						job->direct_key = object_cache::direct_key(cmd, job->source);
+						std::string key;
+						if (cache.lookup(job->direct_key, key) && cache.fetch(key, objfile, depfile)) {
+							job->cache_key = key;
+							job->direct_hit = true;
+							finish(false);
+							return true;
+						}
+						if (!object_cache::key(cmd, job->cache_key, job->headers))
+							return false;
+						if (!cache.fetch(job->cache_key, objfile, depfile)) {
+							if (!remote.fetch("object " + job->cache_key, { objfile, depfile }))
+								return false;
+							job->remote_hit = true;
+						}
+						finish(false);
+						return true;
+					};
+				}
+				build_graph::node compile{ .args = cmd, .deps = compile_deps, .key = objfile, .kind = "compile",
+					.up_to_date = up_to_date,
+					// inputs are stamped when the compile starts (or is looked up), so generated sources and edits made during the build are seen
+					.before = [this, cancel, job]() {
+						if (cancel)
+							*cancel = false;
+						if (job->cache_key.empty())
+							job->stamp = object_history::input_stamp(job->source, fdeps);
+					},
+					.after = [finish]() { finish(true); },
+					.cancel = cancel };
+				if (uses_pch && !pch_current) {
+					if (up_to_date) {
+						size_t lookup = graph.add({ .args = cmd, .deps = node_deps, .key = "lookup " + objfile, .kind = "lookup",
+							.up_to_date = [up_to_date, job]() { job->looked_up = up_to_date(); return true; } });
+						pch_deps.push_back(lookup);
+						compile.deps.push_back(lookup);
+						compile.up_to_date = [job]() { return job->looked_up; };
+					}
+					pch_jobs.push_back(job);
+					pch_compiles.push_back(std::move(compile));
+				} else {
+					if (provides_module)
+						module_nodes[file] = graph.size();
+					build_nodes.push_back(graph.add(std::move(compile)));
+				}
+			}
+			obj_files.push_back(objfile);
+			if (c_file ? c_time_trace : cpp_time_trace) {
+				time_trace_sources.push_back(file);
+				time_trace_files.push_back(std::filesystem::path(objfile).replace_extension(".json").string());
 			}
 		}
 	}
-	std::stringstream linkcmd;
-	if (info.type != project_t::STATIC_LIBRARY) {
-		linkcmd << linker << " -o \"./build/" << info.name << proj_fileext(info.type) << "\"";
-		for (const auto &of : obj_files) {
-			linkcmd << " \"" << of << "\"";
+	if (!pch_compiles.empty()) {
+		if (verbose)
+			std::cout << prettyErrorGeneral(join_command(pchcmd), severity::DEBUG) << std::endl;
+		auto stamp = std::make_shared<uint64_t>();
+		size_t pch_node = graph.add({ .args = pchcmd, .deps = pch_deps, .key = pch_file, .kind = "pch",
+			.up_to_date = [this, pch_file, pch_stamp, pch_jobs]() {
+				return std::all_of(pch_jobs.begin(), pch_jobs.end(), [](const auto &job) { return job->looked_up; }) ||
+					(std::filesystem::exists(pch_file) && objhist.recorded(pch_file) == pch_stamp());
+			},
+			.before = [stamp, pch_stamp]() { *stamp = pch_stamp(); },
+			.after = [this, pch_file, stamp]() { objhist.record(pch_file, *stamp); } });
+		for (auto &compile : pch_compiles) {
+			compile.deps.push_back(pch_node);
+			build_nodes.push_back(graph.add(std::move(compile)));
 		}
-		linkcmd << link_options;
 	}
-	if (verbose)
-		std::cout << prettyErrorGeneral(linkcmd.str(), severity::DEBUG) << std::endl;
-	if (!std::filesystem::exists("./.pyr/objfiles/")) {
-		std::filesystem::create_directories("./.pyr/objfiles/");
+	for (const auto &file : files) {
+		bool c_cpp_header_file = file.ends_with(".c") || file.ends_with(".cpp") || is_module_interface_file(file) || file.ends_with(".h") || file.ends_with(".hpp");
+		if (c_cpp_header_file && std::find(generated_files.begin(), generated_files.end(), file) == generated_files.end()) {
+			hist.update(file);
+		}
 	}
-	if (build_using(build_cmds, linkcmd.str(), "building " + info.name)) {
-		std::cout << prettyErrorGeneral("failed building " + info.name, severity::ERROR) << std::endl;
-		exit(-1);
+	if (info.type != project_t::STATIC_LIBRARY) {
+		std::string target(target_file());
+		std::vector<std::string> linkcmd(split_command(linker));
+		linkcmd.insert(linkcmd.end(), { "-o", target });
+		linkcmd.insert(linkcmd.end(), obj_files.begin(), obj_files.end());
+		linkcmd.insert(linkcmd.end(), link_options.begin(), link_options.end());
+		// the link is recorded like an object - with the target it wrote, which another configuration might have replaced since
+		auto linked = [this, target, linkcmd, obj_files, libs = info.stdlibs]() {
+			return object_history::object_stamp(link_inputs(linkcmd, obj_files, libs, objhist), current_stamp(target).hash);
+		};
+		auto link_key = [this, linkcmd, obj_files, libs = info.stdlibs]() {
+			return "link " + std::to_string(link_inputs(linkcmd, obj_files, libs, objhist));
+		};
+		if (!build_nodes.empty() || objhist.recorded(target) != linked()) {
+			if (verbose)
+				std::cout << prettyErrorGeneral(join_command(linkcmd), severity::DEBUG) << std::endl;
+			std::vector<size_t> link_deps(prebuild_nodes);
+			link_deps.insert(link_deps.end(), build_nodes.begin(), build_nodes.end());
+			// compiles that turn out up to date leave the objects as they were linked
+			graph.add({ .args = linkcmd, .deps = link_deps, .key = target, .kind = "link",
+				// or the remote cache has the target of the same link from another machine
+				.up_to_date = [this, target, linked, link_key]() {
+					if (objhist.recorded(target) == linked())
+						return true;
+					if (!remote.fetch(link_key(), { target }))
+						return false;
+					objhist.record(target, linked());
+					return true;
+				},
+				.after = [this, target, linked, link_key]() {
+					objhist.record(target, linked());
+					remote.upload(link_key(), { target });
+				} });
+		}
 	}
-	std::ofstream flb(last_build_file);
-	uint16_t build_data = static_cast<uint16_t>(obfuscate) << 1 | release;
-	flb << build_data;
-	std::cout << prettyErrorGeneral("\x1b[92mbuilt " + info.name + colReset, severity::INFO) << std::endl;
+	for (const auto &dir : obj_dirs)
+		std::filesystem::create_directories(dir);
+	if (!providers.empty())
+		std::filesystem::create_directories(state_dir + bmi_dir);
+	built = true;
 }
 void project::post_build() {
+	// post-build commands wait for everything else, serial ones first
+	std::vector<size_t> serial_dep;
+	for (size_t n = 0; n < graph.size(); ++n)
+		serial_dep.push_back(n);
+	for (const auto &cmd : postbuild_commands)
+		serial_dep = { graph.add({ .args = shell_command(cmd), .deps = serial_dep }) };
+	for (const auto &cmd : postbuild_parallel_commands)
+		graph.add({ .args = shell_command(cmd), .deps = serial_dep });
+}
+bool project::execute() {
+	drop_tree_scan(); // commands change the tree
+	bool failed = !graph.empty() && run_graph(graph, built ? "building " + info.name : info.name + " commands", jobhist);
+	{
+		std::lock_guard<std::mutex> lock(fdeps_mutex);
+		for (auto &job : compile_jobs) {
+			if (job->reported_deps)
+				fdeps.set_compiler_deps(job->source, std::move(*job->reported_deps));
+		}
+	}
+	remote.wait();
+	if (built)
+		cache.trim();
+	if (!graph.empty() && jobhist.save(state_dir + jobstats_file)) {
+		std::cout << prettyErrorGeneral("failed saving job statistics", severity::WARN) << std::endl;
+	}
+	if (built && objhist.save(state_dir + objhist_file)) {
+		std::cout << prettyErrorGeneral("failed saving object history", severity::WARN) << std::endl;
+	}
+	if (failed) {
+		if (std::any_of(compile_cancel.begin(), compile_cancel.end(), [](const auto &c) { return c.second.load(); }))
+			std::cout << prettyErrorGeneral("sources changed while building " + info.name, severity::NOTE) << std::endl;
+		else
+			std::cout << prettyErrorGeneral((built ? "failed building " : "failed running commands of ") + info.name, severity::ERROR) << std::endl;
+		// the next build of a resident project retries from the same state a new pyruvic process would see
+		hist = hist_at_load;
+		// dependencies of the objects that were built match their recorded stamps
+		if (built)
+			fdeps.save(state_dir + filedeps_file);
+		return true;
+	}
+	for (const auto &file : generated_files) {
+		fdeps.save_c_cpp_deps(file);
+		hist.update(file);
+	}
+	if (built && !time_trace_files.empty()) {
+		print_time_report(time_trace_files, time_trace_sources, fdeps);
+	}
+	if (built) {
+		std::cout << prettyErrorGeneral("\x1b[92mbuilt " + info.name + colReset, severity::INFO) << std::endl;
+	}
 	hist.update("./pyruvic.projinfo");
-	if (hist.save(filehist_file)) {
+	// the link's stamp hashes the target - recorded, a no-op build in a new process only compares its size and mtime
+	if (built && !target_file().empty())
+		hist.update(target_file());
+	if (hist.save(state_dir + filehist_file)) {
 		std::cout << prettyErrorGeneral("failed saving file history", severity::ERROR) << std::endl;
 	}
-	if (fdeps.save(filedeps_file)) {
+	if (fdeps.save(state_dir + filedeps_file)) {
 		std::cout << prettyErrorGeneral("failed saving file dependencies", severity::ERROR) << std::endl;
 		std::cout << prettyErrorGeneral("if file history was saved, project might not build correctly next time", severity::WARN) << std::endl;
-		std::cout << prettyErrorGeneral("deleting file history (./.pyr/filehist) recommended", severity::NOTE) << std::endl;
+		std::cout << prettyErrorGeneral("deleting file history (" + state_dir + filehist_file + ") recommended", severity::NOTE) << std::endl;
 	}
-
-	if (!postbuild_commands.empty())
-		run_commands(prebuild_commands, info.name + " post-build commands");
-	if (!postbuild_parallel_commands.empty())
-		run_commands_parallel(postbuild_parallel_commands, info.name + " post-build commands (parallel)");
+	return false;
+}
+std::string project::target_file() const {
+	return info.type == project_t::STATIC_LIBRARY ? "" : "./build/" + info.name + proj_fileext(info.type);
+}
+bool project::outputs_exist() const {
+	std::string target(target_file());
+	if (!target.empty() && !std::filesystem::exists(target))
+		return false;
+	return std::all_of(source_files.begin(), source_files.end(), [this](const std::string &file) {
+		bool compiled = file.ends_with(".c") || file.ends_with(".cpp") || is_module_interface_file(file);
+		return !compiled || std::filesystem::exists(object_file(file));
+	});
 }
 void project::run() const {
 	if (info.type != project_t::STATIC_LIBRARY)
-		system(("./build/" + info.name + proj_fileext(info.type)).c_str());
+		system(target_file().c_str());
+}
+void project::watch(bool release, bool obfuscate) {
+	file_watcher watcher;
+	if (watcher.init()) {
+		std::cout << prettyErrorGeneral("could not watch ./src/ for changes", severity::FATAL) << std::endl;
+		exit(-1);
+	}
+	watching = true;
+	if (load(release, obfuscate))
+		exit(-1);
+	while (true) {
+		pre_build();
+		build(release, obfuscate);
+		post_build();
+		// edits made during the build cancel the compiles they make stale and start the next build right away
+		std::set<std::string> changed;
+		std::atomic<bool> building = true;
+		std::thread stale_canceller([this, &watcher, &changed, &building]() {
+			while (building) {
+				for (const auto &file : watcher.wait(100)) {
+					if (produced_by_build(file))
+						continue;
+					changed.insert(file);
+					cancel_compiles_of(file);
+				}
+			}
+		});
+		execute();
+		building = false;
+		stale_canceller.join();
+		if (interrupt_received())
+			return;
+		while (changed.empty()) {
+			std::cout << prettyErrorGeneral("watching for changes", severity::INFO) << std::endl;
+			for (const auto &file : watcher.wait(-1)) {
+				if (!produced_by_build(file))
+					changed.insert(file);
+			}
+		}
+		if (reload())
+			exit(-1);
+	}
+}
+void project::reset_build() {
+	graph.clear();
+	prebuild_nodes.clear();
+	build_nodes.clear();
+	generated_files.clear();
+	time_trace_sources.clear();
+	time_trace_files.clear();
+	built = false;
+	prebuild_commands.clear();
+	prebuild_parallel_commands.clear();
+	postbuild_commands.clear();
+	postbuild_parallel_commands.clear();
+	depends.clear();
+	compile_cancel.clear();
+	compile_jobs.clear();
+}
+bool project::produced_by_build(const std::string &file) const {
+	std::filesystem::path p(std::filesystem::path(file).lexically_normal());
+	return (!info.cfg_file.empty() && p == std::filesystem::path(info.cfg_file).lexically_normal()) ||
+		std::find(generated_files.begin(), generated_files.end(), file) != generated_files.end();
+}
+bool project::has_unconditional_commands() {
+	for (const auto &subc : projfile["[commands]"]) {
+		for (const auto &vp : subc.second) {
+			for (const auto &vl : vp.second) {
+				if (vl.first == "__always__:")
+					return true;
+			}
+		}
+	}
+	return false;
+}
+void project::cancel_compiles_of(const std::string &file) {
+	std::lock_guard<std::mutex> lock(fdeps_mutex);
+	for (auto &c : compile_cancel) {
+		if (c.first == file || fdeps.included_files(c.first).contains(file))
+			c.second = true;
+	}
+}
+std::string project::object_file(const std::string &source) const {
+	// objects mirror the source tree, so sources with the same name don't share one
+	std::filesystem::path objpath(state_dir + objfiles_dir);
+	objpath /= std::filesystem::path(source).lexically_normal().lexically_relative("src");
+	return objpath.replace_extension(objfile_ext).string();
+}
+std::map<std::string, module_deps> project::scan_modules(const std::vector<std::string> &sources, const std::vector<std::string> &options) {
+	trace_scope trace("scanning modules", "scan");
+	struct scan_job {
+		std::string source;
+		std::string objfile;
+		std::string ddifile;
+		std::vector<std::string> cmd;
+		uint64_t stamp;
+	};
+	std::map<std::string, module_deps> found;
+	std::vector<scan_job> scans;
+	input_state inputs(fdeps);
+	for (const auto &source : sources) {
+		std::string objfile(object_file(source));
+		std::string ddifile(std::filesystem::path(objfile).replace_extension(".ddi").string());
+		std::vector<std::string> cmd(module_scan_command(options, source, objfile, ddifile));
+		uint64_t stamp = object_history::object_stamp(inputs.signature(source), module_scan_fingerprint(cmd));
+		module_deps deps;
+		if (objhist.recorded(ddifile) == stamp && read_p1689(ddifile, deps))
+			found.emplace(source, std::move(deps));
+		else
+			scans.push_back({ source, objfile, ddifile, cmd, stamp });
+	}
+	// the scans preprocess, they run in parallel - with jobserver tokens and as many as the memory admits, like the graph's jobs
+	std::mutex found_mutex;
+	std::atomic<size_t> next = 0;
+	auto work = [&]() {
+		for (size_t i; (i = next++) < scans.size();) {
+			std::filesystem::create_directories(std::filesystem::path(scans[i].ddifile).parent_path());
+			module_deps deps;
+			// without a token the declarations are read instead, results of a failed scan aren't kept either
+			bool token = jobs.acquire();
+			bool scanned = scan_module_deps(token ? scans[i].cmd : std::vector<std::string>(), scans[i].source, scans[i].objfile, scans[i].ddifile, deps);
+			if (token) {
+				jobs.release();
+				if (scanned)
+					objhist.record(scans[i].ddifile, scans[i].stamp);
+			}
+			std::lock_guard<std::mutex> lock(found_mutex);
+			found.emplace(scans[i].source, std::move(deps));
+		}
+	};
+	uint64_t threadc = std::min<uint64_t>({ init_jobserver(), std::max<uint64_t>(job_memory_budget() / default_job_memory, 1), scans.size() });
+	std::vector<std::thread> threads;
+	for (uint64_t i = 1; i < threadc; ++i)
+		threads.emplace_back(work);
+	work();
+	for (auto &t : threads)
+		t.join();
+	return found;
 }
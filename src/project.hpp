@@ -1,8 +1,18 @@
 #ifndef __PROJECT_HPP__
 #define __PROJECT_HPP__
 
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
+#include "cache.hpp"
+#include "cmdutils.hpp"
+#include "modules.hpp"
+#include "remote.hpp"
 #include "project_utils.hpp"
 #include "runtime_config.hpp"
 
@@ -10,20 +20,72 @@ class project {
 public:
 	project_info info;
 
-	void load(bool release, bool obfuscate);
+	// true when the project file is missing or invalid
+	bool load(bool release, bool obfuscate);
+	// starts the next build of a loaded project, re-reads the project file only when it changed
+	bool reload();
 	void clean_build_files() const;
 	void pre_build();
 	void build(bool release, bool obfuscate);
 	void post_build();
+	bool execute();
 	void run() const;
+	// builds whenever sources or the project file change, until interrupted
+	void watch(bool release, bool obfuscate);
+	std::string target_file() const;
+	// the target and the objects of the sources are there (nothing deleted them since the last build)
+	bool outputs_exist() const;
+	bool produced_by_build(const std::string &file) const;
+	bool has_unconditional_commands();
 private:
+	pyruvic_file projfile;
+	std::filesystem::file_time_type projfile_time;
+	std::string state_dir; // of the build configuration
+	file_history hist_at_load;
 	file_history hist;
 	file_dependencies fdeps;
+	object_history objhist;
+	job_history jobhist;
+	build_graph graph;
+	std::vector<size_t> prebuild_nodes;
+	std::vector<size_t> build_nodes;
+	std::vector<std::string> source_files;
+	std::vector<std::string> generated_files;
+	std::vector<std::string> time_trace_sources;
+	std::vector<std::string> time_trace_files;
+	bool built = false;
+	bool watching = false;
+	std::map<std::string, std::atomic<bool>> compile_cancel; // by source file, only while watching
+	std::mutex fdeps_mutex; // dependencies change after the compiles while the watch thread reads them
+	object_cache cache;
+	remote_cache remote;
+	// state of a compile while the graph runs
+	struct compile_job {
+		std::string source;
+		uint64_t stamp = 0; // inputs when the compile started
+		std::string cache_key;
+		std::string direct_key;
+		bool direct_hit = false; // found through the manifest
+		bool remote_hit = false;
+		bool looked_up = false; // up to date or a cache hit before the prefix header was compiled
+		std::vector<std::string> headers; // the preprocessor read when computing cache_key
+		std::optional<std::vector<std::string>> reported_deps; // from the depfile
+	};
+	std::vector<std::shared_ptr<compile_job>> compile_jobs;
 	std::vector<std::string> prebuild_commands;
 	std::vector<std::string> prebuild_parallel_commands;
 	std::vector<std::string> postbuild_commands;
 	std::vector<std::string> postbuild_parallel_commands;
 	std::vector<std::pair<std::string, std::string>> depends;
+
+	bool read_project_file();
+	void load_state(bool release, bool obfuscate);
+	void select_commands();
+	void reset_build();
+	void cancel_compiles_of(const std::string &file);
+	std::string object_file(const std::string &source) const;
+	// module dependencies of the sources - a scan is kept next to the object until the source or what it includes changes
+	std::map<std::string, module_deps> scan_modules(const std::vector<std::string> &sources, const std::vector<std::string> &options);
 };
 
 #endif
@@ -11,6 +11,7 @@
 #include "parsing/lex.hpp"
 #include "parsing/par.hpp"
 #include "runtime_config.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 
 extern bool verbose;
@@ -59,6 +60,11 @@ void replace_vars(const project_info &info, std::string &str) {
 			break;
 	}
 }
+std::string config_dir(bool release, bool obfuscate) {
+	if (!release)
+		return "./.pyr/debug/";
+	return obfuscate ? "./.pyr/release-obfuscated/" : "./.pyr/release/";
+}
 std::string proj_fileext(project_t t) {
 	switch (t) {
 #if defined(__linux__)
@@ -74,33 +80,48 @@ std::string proj_fileext(project_t t) {
 	return "";
 }
 
-void load_cfg() {
+bool load_cfg() {
+	trace_scope trace("load_cfg", "config");
 	pyruvic_path = get_exe_path();
 	if (pyruvic_path.empty()) {
 		std::cout << prettyErrorGeneral("Couldn't get executable path :c", severity::FATAL) << std::endl;
-		exit(-1);
+		return true;
 	}
 	std::string cfg_file(pyruvic_path + "/pyruvic.cfg");
 	std::cout << prettyErrorGeneral("loading config file - " + cfg_file, severity::INFO) << std::endl;
 	std::ifstream f(cfg_file);
 	std::stringstream cfg_ss;
 	cfg_ss << f.rdbuf();
-	tokenstream ts = lex(cfg_file, cfg_ss);
-	pyruvic_file cfg(parse(ts));
+	tokenstream ts;
+	{
+		trace_scope trace("lexing " + cfg_file, "config");
+		ts = lex(cfg_file, cfg_ss);
+	}
+	pyruvic_file cfg;
+	{
+		trace_scope trace("parsing " + cfg_file, "config");
+		cfg = parse(ts);
+	}
 	const value_list &c_compilers = get_val_list_by_platform(cfg["[compilation]"][""], "c-compiler:");
 	const value_list &cpp_compilers =get_val_list_by_platform(cfg["[compilation]"][""], "c++-compiler:");
 	const value_list &linkers = get_val_list_by_platform(cfg["[compilation]"][""], "linker:");
+	// the daemon loads a changed config again
+	c_compiler.clear();
+	cpp_compiler.clear();
+	linker.clear();
 	for (const auto &c_comp : c_compilers) { if (command_exists(c_comp)) { c_compiler = c_comp; break; } }
 	for (const auto &cpp_comp : cpp_compilers) { if (command_exists(cpp_comp)) { cpp_compiler = cpp_comp; break; } }
 	for (const auto &link : linkers) { if (command_exists(link)) { linker = link; break; } }
-	if (c_compiler.empty()) { std::cout << prettyErrorGeneral("Could not find C compiler.", severity::FATAL) << std::endl; exit(-1); }
-	if (cpp_compiler.empty()) { std::cout << prettyErrorGeneral("Could not find C++ compiler.", severity::FATAL) << std::endl; exit(-1); }
-	if (linker.empty()) { std::cout << prettyErrorGeneral("Could not find linker.", severity::FATAL) << std::endl; exit(-1); }
+	if (c_compiler.empty()) { std::cout << prettyErrorGeneral("Could not find C compiler.", severity::FATAL) << std::endl; return true; }
+	if (cpp_compiler.empty()) { std::cout << prettyErrorGeneral("Could not find C++ compiler.", severity::FATAL) << std::endl; return true; }
+	if (linker.empty()) { std::cout << prettyErrorGeneral("Could not find linker.", severity::FATAL) << std::endl; return true; }
 	linker = cpp_compiler + " -fuse-ld=" + linker; // TODO: change this
 
+	deps = dependency_info(); // the daemon reloads a changed config
 	deps.load(cfg["[auogen-libraries]"]);
 	deps.load(cfg["[pkg-config-auogen-libraries]"]);
 	deps.load(cfg["[known-libraries]"]);
+	return false;
 }
 void new_project(const std::string &name) {
 	std::string path("./" + name + "/");
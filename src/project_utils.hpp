@@ -10,10 +10,16 @@ constexpr const char *platform_idents[] = { "unix" };
 constexpr const char *platform_idents[] = { "win" };
 #endif
 
-constexpr const char *filehist_file = "./.pyr/filehist";
-constexpr const char *filedeps_file = "./.pyr/filedeps";
-constexpr const char *last_build_file = "./.pyr/last_build";
+// state files and objects are kept per build configuration, in config_dir
+constexpr const char *filehist_file = "filehist";
+constexpr const char *filedeps_file = "filedeps";
+constexpr const char *objhist_file = "objhist";
+constexpr const char *jobstats_file = "jobstats";
+constexpr const char *objfiles_dir = "objfiles/";
 constexpr const char *objfile_ext = ".o";
+constexpr const char *pch_dir = "pch/";
+constexpr const char *bmi_dir = "bmi/";
+constexpr const char *pch_prefix_file = "prefix.hpp";
 enum class project_t { EXECUTABLE, STATIC_LIBRARY, DYNAMIC_LIBRARY };
 
 extern std::string pyruvic_path;
@@ -24,8 +30,11 @@ struct project_info;
 const value_list &get_val_list_by_platform(const subcategory &subcat, const std::string &name);
 void replace_vars(const project_info &info, std::string &str);
 std::string proj_fileext(project_t t);
+// ./.pyr/debug/, ./.pyr/release/ or ./.pyr/release-obfuscated/
+std::string config_dir(bool release, bool obfuscate);
 
-void load_cfg();
+// true when the config is unusable (no compiler or linker found)
+bool load_cfg();
 void new_project(const std::string &);
 
 #endif
@@ -0,0 +1,230 @@
+#include "remote.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+#include "formatted_out.hpp"
+#include "hash.hpp"
+#include "http.hpp"
+#include "util.hpp"
+
+constexpr unsigned int remote_uploaders = 4;
+
+// the few protobuf messages of the remote execution api that are used (build.bazel.remote.execution.v2)
+// ActionResult { repeated OutputFile output_files = 2; }
+// OutputFile { string path = 1; Digest digest = 2; bool is_executable = 4; bytes contents = 5; }
+// Digest { string hash = 1; int64 size_bytes = 2; }
+void put_varint(std::string &out, uint64_t v) {
+	for (; v >= 0x80; v >>= 7)
+		out.push_back(static_cast<char>(v | 0x80));
+	out.push_back(static_cast<char>(v));
+}
+void put_varint_field(std::string &out, int field, uint64_t v) {
+	put_varint(out, static_cast<uint64_t>(field) << 3);
+	put_varint(out, v);
+}
+void put_bytes_field(std::string &out, int field, std::string_view bytes) {
+	put_varint(out, static_cast<uint64_t>(field) << 3 | 2);
+	put_varint(out, bytes.size());
+	out.append(bytes);
+}
+bool get_varint(std::string_view msg, size_t &pos, uint64_t &v) {
+	v = 0;
+	for (int shift = 0; shift < 64 && pos < msg.size(); shift += 7) {
+		unsigned char b = static_cast<unsigned char>(msg[pos++]);
+		v |= static_cast<uint64_t>(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+// calls field(number, varint, bytes) for every varint and length delimited field, false when the message is malformed
+template<typename F> bool read_message(std::string_view msg, F field) {
+	for (size_t pos = 0; pos < msg.size();) {
+		uint64_t tag, v;
+		if (!get_varint(msg, pos, tag))
+			return false;
+		switch (tag & 7) {
+		case 0:
+			if (!get_varint(msg, pos, v))
+				return false;
+			field(static_cast<int>(tag >> 3), v, std::string_view());
+			break;
+		case 1: pos += 8; break;
+		case 5: pos += 4; break;
+		case 2:
+			if (!get_varint(msg, pos, v) || v > msg.size() - pos)
+				return false;
+			field(static_cast<int>(tag >> 3), 0, msg.substr(pos, v));
+			pos += v;
+			break;
+		default:
+			return false;
+		}
+		if (pos > msg.size())
+			return false;
+	}
+	return true;
+}
+
+remote_cache::~remote_cache() {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_cv.notify_all();
+	for (auto &t : uploaders)
+		t.join();
+}
+void remote_cache::init(const std::string &cache_url, bool ro, int timeout) {
+	url = cache_url;
+	while (url.ends_with('/'))
+		url.pop_back();
+	read_only = ro;
+	timeout_ms = timeout;
+	reachable = !url.empty();
+	if (!url.empty() && !url.starts_with("http://")) {
+		std::cout << prettyErrorGeneral("remote cache needs an http:// url - " + url, severity::WARN) << std::endl;
+		reachable = false;
+	}
+}
+bool remote_cache::enabled() const {
+	return reachable;
+}
+bool remote_cache::request(const std::string &method, const std::string &path, const std::string &body, int &status, std::string &response) {
+	if (!reachable)
+		return false;
+	http_response res;
+	if (!http_request(method, url + path, body, timeout_ms, res)) {
+		if (reachable.exchange(false))
+			std::cout << prettyErrorGeneral("remote cache " + url + " didn't answer - building locally", severity::WARN) << std::endl;
+		return false;
+	}
+	status = res.status;
+	response = std::move(res.body);
+	return true;
+}
+bool remote_cache::fetch(const std::string &key, const std::vector<std::string> &files) {
+	int status;
+	std::string result;
+	if (!request("GET", "/ac/" + sha256_hex(key), "", status, result) || status != 200)
+		return false;
+	struct found_file {
+		std::string hash;
+		uint64_t size = 0;
+		bool executable = false;
+		std::string contents;
+	};
+	std::vector<std::pair<std::string, found_file>> listed;
+	bool valid = read_message(result, [&listed](int field, uint64_t, std::string_view bytes) {
+		if (field != 2)
+			return;
+		std::string path;
+		found_file f;
+		read_message(bytes, [&path, &f](int field, uint64_t v, std::string_view bytes) {
+			if (field == 1)
+				path = bytes;
+			else if (field == 4)
+				f.executable = v != 0;
+			else if (field == 5)
+				f.contents = bytes;
+			else if (field == 2) {
+				read_message(bytes, [&f](int field, uint64_t v, std::string_view bytes) {
+					if (field == 1)
+						f.hash = bytes;
+					else if (field == 2)
+						f.size = v;
+				});
+			}
+		});
+		listed.emplace_back(std::move(path), std::move(f));
+	});
+	if (!valid)
+		return false;
+	// everything is downloaded before any file is written, a partial hit leaves the old outputs
+	std::vector<std::pair<std::string, found_file>> outputs;
+	for (const auto &file : files) {
+		auto it = std::find_if(listed.begin(), listed.end(), [&file](const auto &l) { return l.first == file; });
+		if (it == listed.end())
+			return false;
+		found_file &f = it->second;
+		if (f.contents.size() != f.size || sha256_hex(f.contents) != f.hash) {
+			if (!request("GET", "/cas/" + f.hash, "", status, f.contents) || status != 200 ||
+				f.contents.size() != f.size || sha256_hex(f.contents) != f.hash)
+				return false;
+		}
+		outputs.emplace_back(file, std::move(f));
+	}
+	for (const auto &o : outputs) {
+		if (!replace_file(o.first, o.second.contents))
+			return false;
+		if (o.second.executable) {
+			std::error_code ec;
+			std::filesystem::permissions(o.first, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec |
+				std::filesystem::perms::others_exec, std::filesystem::perm_options::add, ec);
+		}
+	}
+	return true;
+}
+void remote_cache::upload(const std::string &key, const std::vector<std::string> &files) {
+	if (!reachable || read_only)
+		return;
+	action a{ key, {} };
+	for (const auto &file : files) {
+		output o{ file, "", false };
+		if (!read_file(file, o.content))
+			return;
+		std::error_code ec;
+		o.executable = (std::filesystem::status(file, ec).permissions() & std::filesystem::perms::owner_exec) != std::filesystem::perms::none;
+		a.outputs.push_back(std::move(o));
+	}
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	queue.push_back(std::move(a));
+	if (uploaders.size() < remote_uploaders && uploaders.size() < queue.size() + uploading)
+		uploaders.emplace_back(&remote_cache::upload_worker, this);
+	queue_cv.notify_all();
+}
+void remote_cache::wait() {
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	queue_cv.wait(lock, [this]() { return queue.empty() && uploading == 0; });
+}
+void remote_cache::upload_worker() {
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	while (true) {
+		queue_cv.wait(lock, [this]() { return !queue.empty() || stopping; });
+		if (queue.empty())
+			return;
+		action a(std::move(queue.front()));
+		queue.pop_front();
+		++uploading;
+		lock.unlock();
+		put(a);
+		lock.lock();
+		--uploading;
+		queue_cv.notify_all();
+	}
+}
+// contents first, the action result is only valid once everything it names is there
+void remote_cache::put(const action &a) {
+	std::string result;
+	for (const auto &o : a.outputs) {
+		std::string hash(sha256_hex(o.content));
+		int status;
+		std::string response;
+		if (!request("PUT", "/cas/" + hash, o.content, status, response) || status / 100 != 2)
+			return;
+		std::string digest;
+		put_bytes_field(digest, 1, hash);
+		put_varint_field(digest, 2, o.content.size());
+		std::string file;
+		put_bytes_field(file, 1, o.path);
+		put_bytes_field(file, 2, digest);
+		if (o.executable)
+			put_varint_field(file, 4, 1);
+		put_bytes_field(result, 2, file);
+	}
+	int status;
+	std::string response;
+	request("PUT", "/ac/" + sha256_hex(a.key), result, status, response);
+}
@@ -0,0 +1,56 @@
+#ifndef __REMOTE_HPP__
+#define __REMOTE_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+constexpr int default_remote_timeout = 5000; // ms
+
+// HTTP remote cache in the layout of Bazel's (bazel-remote, ...) - /ac/<sha256 of the key> holds an ActionResult
+// that names the output files, /cas/<sha256 of the content> holds their contents
+// a cache that doesn't answer in time is left alone for the rest of the process, everything is built locally then
+class remote_cache {
+public:
+	~remote_cache();
+	// http://host[:port][/prefix], disabled with an empty url
+	void init(const std::string &url, bool read_only, int timeout_ms);
+	bool enabled() const;
+	// writes the outputs of the action to the files (matched by path), false on a miss
+	bool fetch(const std::string &key, const std::vector<std::string> &files);
+	// reads the files right away and uploads them in the background
+	void upload(const std::string &key, const std::vector<std::string> &files);
+	// waits for the uploads
+	void wait();
+private:
+	struct output {
+		std::string path;
+		std::string content;
+		bool executable;
+	};
+	struct action {
+		std::string key;
+		std::vector<output> outputs;
+	};
+	std::string url;
+	bool read_only = false;
+	int timeout_ms = default_remote_timeout;
+	std::atomic<bool> reachable = false;
+	std::deque<action> queue;
+	unsigned int uploading = 0;
+	bool stopping = false;
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::vector<std::thread> uploaders;
+
+	bool request(const std::string &method, const std::string &path, const std::string &body, int &status, std::string &response);
+	void upload_worker();
+	void put(const action &a);
+};
+
+#endif
@@ -1,78 +1,348 @@
 #include "runtime_config.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <unordered_set>
 #include "formatted_out.hpp"
+#include "hash.hpp"
+#include "process.hpp"
+#include "scan.hpp"
+#include "state_file.hpp"
+#include "util.hpp"
 #include "project_utils.hpp"
 
 std::string c_compiler;
 std::string cpp_compiler;
 std::string linker;
 
+std::string resolve_dependency(const std::string &file, const std::string &dep) {
+	std::filesystem::path dp(std::filesystem::path(file).parent_path());
+	dp.append(dep);
+	dp = "./" / std::filesystem::relative(dp);
+	return dp.string();
+}
+
+struct file_history_record {
+	state_string file;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t hash;
+	uint64_t builds;
+};
+struct file_dependencies_record {
+	state_string file;
+	uint64_t flags;
+	uint64_t first_dep;
+	uint64_t dep_count;
+};
+constexpr uint64_t deps_from_compiler = 1;
+
+std::map<std::string, file_stamp> stamp_cache;
+std::mutex stamp_cache_mutex;
+// a program is asked again when the executable behind its name changed (an upgrade while the daemon runs)
+struct program_state {
+	std::string path;
+	uint64_t size = 0;
+	uint64_t mtime = 0;
+	uint64_t identity = 0;
+};
+std::map<std::string, program_state> program_identities;
+std::mutex program_identities_mutex;
+struct found_library {
+	uint64_t compiler; // identity of the compiler that found it
+	std::string path;
+};
+std::map<std::pair<std::string, std::string>, found_library> found_libraries;
+std::mutex found_libraries_mutex;
+
+// recorded stamps stand for the hash while size and mtime are the same, so a new process doesn't hash every file again
+void remember_stamps(const file_history &hist) {
+	std::lock_guard<std::mutex> lock(stamp_cache_mutex);
+	for (const auto &rec : hist)
+		stamp_cache.emplace(rec.first, rec.second);
+}
+file_stamp current_stamp(const std::string &file) {
+	file_stat st(stat_file(file));
+	if (!st.exists)
+		return file_stamp();
+	file_stamp stamp{ st.size, st.mtime, 0 };
+	{
+		std::lock_guard<std::mutex> lock(stamp_cache_mutex);
+		auto it = stamp_cache.find(file);
+		if (it != stamp_cache.end() && it->second.size == stamp.size && it->second.mtime == stamp.mtime)
+			return it->second;
+	}
+	if (!hash_file(file, stamp.hash))
+		return file_stamp();
+	std::lock_guard<std::mutex> lock(stamp_cache_mutex);
+	stamp_cache[file] = stamp;
+	return stamp;
+}
+
 bool file_history::was_updated(const std::string &file) const {
-	if (!std::filesystem::exists(file)) {
+	if (!stat_file(file).exists) {
 		return true;
 	}
 	auto it = find(file);
 	if (it == end())
 		return true;
-	std::filesystem::file_time_type t = std::filesystem::last_write_time(file);
-	uint64_t now = static_cast<uint64_t>(t.time_since_epoch().count());
-	bool updated = now > it->second;
-	return updated;
-}
-bool file_history::was_updated(const std::string &file, const file_dependencies &deps, unsigned int depth) const {
-	if (depth > 50) {
-		std::cout << prettyErrorGeneral("Exceeded maximum dependency update search depth (" + std::to_string(depth) + ") - counting as updated", severity::WARN) << std::endl;
-		return true;
-	}
-	if (was_updated(file)) {
-		return true;
-	}
-	auto it = deps.find(file);
-	if (it == deps.end()) {
-		return false;
-	}
-	std::filesystem::path p(file);
-	p = p.parent_path();
-	for (const auto &d : it->second) {
-		std::filesystem::path dp(p);
-		dp.append(d);
-		dp = "./" / std::filesystem::relative(dp);
-		if (was_updated(dp.string(), deps, depth + 1)) {
-			std::cout << file << " > " << dp.string() << " upd" << std::endl;
-			return true;
-		}
-	}
-	return false;
+	// a checkout or touch without content changes keeps the hash
+	return current_stamp(file).hash != it->second.hash;
 }
 void file_history::update(const std::string &file) {
-	if (std::filesystem::exists(file)) {
-		std::filesystem::file_time_type t = std::filesystem::last_write_time(file);
-		uint64_t now = static_cast<uint64_t>(t.time_since_epoch().count());
-		(*this)[file] = now;
+	if (stat_file(file).exists) {
+		file_stamp stamp(current_stamp(file));
+		auto it = find(file);
+		stamp.builds = it != end() && it->second.hash == stamp.hash ? it->second.builds + 1 : 0;
+		(*this)[file] = stamp;
 	}
 }
 bool file_history::load_saved(const std::string &file) {
+	state_reader state;
+	if (state.open(file, state_kind::FILE_HISTORY, sizeof(file_history_record))) {
+		for (uint64_t i = 0; i < state.records(); ++i) {
+			file_history_record rec(state.record<file_history_record>(i));
+			emplace_hint(end(), state.string(rec.file), file_stamp{ rec.size, rec.mtime, rec.hash, rec.builds });
+		}
+		remember_stamps(*this);
+		return false;
+	}
+	// text format of older versions, other binary versions are dropped
+	if (is_state_file(file))
+		return false;
 	std::ifstream f(file);
 	if (f.bad())
 		return true;
 	std::string str;
 	while (std::getline(f, str)) {
-		size_t split = str.rfind(' ');
-		insert(std::make_pair(str.substr(0, split), std::stoull(str.substr(split + 1))));
+		// path size mtime hash - lines in other formats (older versions) are dropped, the files count as updated
+		size_t split = str.size();
+		for (int i = 0; i < 3 && split != std::string::npos && split > 0; ++i)
+			split = str.rfind(' ', split - 1);
+		if (split == std::string::npos || split == 0)
+			continue;
+		file_stamp stamp;
+		std::stringstream ss(str.substr(split + 1));
+		if (ss >> stamp.size >> stamp.mtime >> std::hex >> stamp.hash)
+			insert(std::make_pair(str.substr(0, split), stamp));
 	}
+	remember_stamps(*this);
 	return false;
 }
 bool file_history::save(const std::string &file) const {
-	std::ofstream f(file);
+	state_writer state;
+	for (const auto &filedata : *this)
+		state.add_record(file_history_record{ state.add_string(filedata.first), filedata.second.size, filedata.second.mtime, filedata.second.hash, filedata.second.builds });
+	return state.write(file, state_kind::FILE_HISTORY);
+}
+
+input_state::input_state(const file_dependencies &deps, const file_history *hist) : deps(deps), hist(hist) { }
+bool input_state::updated(const std::string &file) {
+	return visit(file).updated;
+}
+uint64_t input_state::signature(const std::string &file) {
+	return visit(file).signature;
+}
+void input_state::set_includes(const std::string &file, std::vector<std::string> deps) {
+	includes[file] = std::move(deps);
+}
+// iterative tarjan - components are completed dependencies first, so everything they include is already done
+const input_state::result &input_state::visit(const std::string &file) {
+	auto found = done.find(file);
+	if (found != done.end())
+		return found->second;
+	struct vertex {
+		size_t index;
+		size_t lowlink;
+		std::vector<std::string> edges;
+	};
+	std::unordered_map<std::string, vertex> vertices;
+	std::vector<std::string> component_stack;
+	std::vector<std::pair<std::string, size_t>> call_stack; // file, next edge
+	auto enter = [&](const std::string &f) {
+		vertex v{ vertices.size(), vertices.size(), {} };
+		auto overridden = includes.find(f);
+		auto it = deps.find(f);
+		const std::vector<std::string> *incl = overridden != includes.end() ? &overridden->second : it != deps.end() ? &it->second : nullptr;
+		if (incl) {
+			for (const auto &d : *incl)
+				v.edges.push_back(resolve_dependency(f, d));
+		}
+		vertices.emplace(f, std::move(v));
+		component_stack.push_back(f);
+		call_stack.emplace_back(f, 0);
+	};
+	enter(file);
+	while (!call_stack.empty()) {
+		std::string f(call_stack.back().first);
+		vertex &v = vertices.at(f);
+		if (call_stack.back().second < v.edges.size()) {
+			std::string d(v.edges[call_stack.back().second++]);
+			if (done.contains(d))
+				continue;
+			auto it = vertices.find(d);
+			if (it == vertices.end())
+				enter(d);
+			else // visited but not done - still on the component stack
+				v.lowlink = std::min(v.lowlink, it->second.index);
+			continue;
+		}
+		call_stack.pop_back();
+		if (!call_stack.empty()) {
+			vertex &parent = vertices.at(call_stack.back().first);
+			parent.lowlink = std::min(parent.lowlink, v.lowlink);
+		}
+		if (v.lowlink != v.index)
+			continue;
+		std::vector<std::string> component;
+		do {
+			component.push_back(std::move(component_stack.back()));
+			component_stack.pop_back();
+		} while (component.back() != f);
+		std::sort(component.begin(), component.end());
+		std::unordered_set<std::string> members(component.begin(), component.end());
+		result res{ false, 0 };
+		xxh64 h;
+		for (const auto &m : component) {
+			uint64_t content = current_stamp(m).hash;
+			h.update(m.data(), m.size() + 1);
+			h.update(&content, sizeof(content));
+			if (hist && hist->was_updated(m))
+				res.updated = true;
+		}
+		for (const auto &m : component) {
+			for (const auto &d : vertices.at(m).edges) {
+				if (members.contains(d))
+					continue;
+				const result &dep = done.at(d);
+				res.updated = res.updated || dep.updated;
+				h.update(&dep.signature, sizeof(dep.signature));
+			}
+		}
+		res.signature = h.digest();
+		for (const auto &m : component)
+			done[m] = res;
+	}
+	return done.at(file);
+}
+
+program_state current_program(const std::string &program) {
+	program_state state;
+	state.path = find_command(program);
+	file_stat st(stat_file(state.path));
+	state.size = st.size;
+	state.mtime = st.mtime;
+	return state;
+}
+uint64_t program_identity(const std::string &program) {
+	program_state current(current_program(program));
+	std::lock_guard<std::mutex> lock(program_identities_mutex);
+	program_state &known = program_identities[program];
+	if (known.identity == 0 || known.path != current.path || known.size != current.size || known.mtime != current.mtime) {
+		// a different version behind the same name compiles differently
+		process_result version(run_process({ program, "--version" }));
+		current.identity = hash_string(std::to_string(version.exit_code) + '\0' + version.out + '\0' + version.err);
+		known = current;
+	}
+	return known.identity;
+}
+bool programs_changed() {
+	std::lock_guard<std::mutex> lock(program_identities_mutex);
+	return std::any_of(program_identities.begin(), program_identities.end(), [](const auto &p) {
+		program_state current(current_program(p.first));
+		return p.second.path != current.path || p.second.size != current.size || p.second.mtime != current.mtime;
+	});
+}
+uint64_t command_fingerprint(const std::vector<std::string> &cmd) {
+	xxh64 h;
+	if (!cmd.empty()) {
+		uint64_t identity = program_identity(cmd[0]);
+		h.update(&identity, sizeof(identity));
+	}
+	for (const auto &arg : cmd)
+		h.update(arg.data(), arg.size() + 1);
+	return h.digest();
+}
+
+std::string find_library(const std::string &compiler, const std::string &lib) {
+	uint64_t identity = program_identity(compiler);
+	std::lock_guard<std::mutex> lock(found_libraries_mutex);
+	auto it = found_libraries.find({ compiler, lib });
+	if (it != found_libraries.end() && it->second.compiler == identity && (it->second.path.empty() || std::filesystem::exists(it->second.path)))
+		return it->second.path;
+	std::string found;
+#if defined(__linux__)
+	const char *names[] = { ".so", ".a" };
+#elif defined(_WIN32)
+	const char *names[] = { ".dll.a", ".a" };
+#endif
+	for (const char *ext : names) {
+		// prints the name back unchanged when the library isn't in its search path
+		process_result res(run_process({ compiler, "-print-file-name=lib" + lib + ext }));
+		std::string path(res.out.substr(0, res.out.find_first_of("\r\n")));
+		if (res.exit_code == 0 && std::filesystem::path(path).is_absolute() && std::filesystem::exists(path)) {
+			found = path;
+			break;
+		}
+	}
+	found_libraries[{ compiler, lib }] = { identity, found };
+	return found;
+}
+
+uint64_t object_history::input_stamp(const std::string &file, const file_dependencies &deps) {
+	return input_state(deps).signature(file);
+}
+uint64_t object_history::object_stamp(uint64_t inputs, uint64_t command) {
+	xxh64 h;
+	h.update(&inputs, sizeof(inputs));
+	h.update(&command, sizeof(command));
+	return h.digest();
+}
+bool object_history::load_saved(const std::string &file) {
+	journal = file;
+	std::ifstream f(file);
 	if (f.bad())
 		return true;
-	for (const auto &filedata : *this) {
-		f << filedata.first << ' ' << filedata.second << std::endl;
+	std::string str;
+	while (std::getline(f, str)) {
+		if (f.eof())
+			break; // unterminated record of an interrupted write
+		// a torn record glued to the next one can't be parsed, or parses to a stamp that just doesn't match
+		size_t split = str.find(' ');
+		uint64_t stamp;
+		if (split == std::string::npos || split + 1 == str.size())
+			continue;
+		auto [end, ec] = std::from_chars(str.data(), str.data() + split, stamp);
+		if (ec != std::errc() || end != str.data() + split)
+			continue;
+		(*this)[str.substr(split + 1)] = stamp;
 	}
 	return false;
 }
+bool object_history::record(const std::string &obj, uint64_t stamp) {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	(*this)[obj] = stamp;
+	std::ofstream f(journal, std::ios::app);
+	f << stamp << ' ' << obj << '\n' << std::flush;
+	return !f.good();
+}
+uint64_t object_history::recorded(const std::string &obj) const {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	auto it = find(obj);
+	return it == end() ? 0 : it->second;
+}
+bool object_history::save(const std::string &file) const {
+	std::lock_guard<std::mutex> lock(journal_mutex);
+	std::stringstream data;
+	for (const auto &obj : *this) {
+		data << obj.second << ' ' << obj.first << '\n';
+	}
+	// another build of the project (the daemon and a CLI build) might save at the same time
+	return !replace_file(file, data.str());
+}
 
 void file_dependencies::save_c_cpp_deps(const std::string &file) {
 	std::ifstream f(file);
@@ -90,10 +360,118 @@ void file_dependencies::save_c_cpp_deps(const std::string &file) {
 				}
 			}
 		}
-		(*this)[file] = deps;
+		// the compiler's list is complete, a scan only adds includes that are new since the last compile
+		if (compiler_deps.contains(file)) {
+			std::vector<std::string> &known = (*this)[file];
+			for (const auto &d : deps) {
+				if (std::find(known.begin(), known.end(), d) == known.end())
+					known.push_back(d);
+			}
+		} else {
+			(*this)[file] = deps;
+		}
+	}
+}
+void file_dependencies::set_compiler_deps(const std::string &file, std::vector<std::string> deps) {
+	(*this)[file] = std::move(deps);
+	compiler_deps.insert(file);
+}
+bool file_dependencies::has_compiler_deps(const std::string &file) const {
+	return compiler_deps.contains(file);
+}
+bool file_dependencies::read_depfile(const std::string &depfile, const std::string &source, std::vector<std::string> &deps) {
+	std::ifstream f(depfile);
+	if (!f.good())
+		return false;
+	std::stringstream ss;
+	ss << f.rdbuf();
+	std::string text(ss.str());
+	// "target: dep dep \<newline> dep", spaces in paths are escaped with '\\' and '$' with '$'
+	std::vector<std::string> words;
+	std::string word;
+	for (size_t i = 0; i < text.size(); ++i) {
+		char c = text[i];
+		char next = i + 1 < text.size() ? text[i+1] : '\0';
+		if (c == '\\' && (next == ' ' || next == '#' || next == '\\')) {
+			word.push_back(next);
+			++i;
+		} else if (c == '\\' && (next == '\n' || next == '\r')) {
+			if (!word.empty())
+				words.push_back(std::move(word));
+			word.clear();
+			i += next == '\r' && i + 2 < text.size() && text[i+2] == '\n' ? 2 : 1;
+		} else if (c == '$' && next == '$') {
+			word.push_back(next);
+			++i;
+		} else if (isspace(static_cast<unsigned char>(c))) {
+			if (!word.empty())
+				words.push_back(std::move(word));
+			word.clear();
+			// only the first rule - with modules gcc adds rules for the interfaces after it
+			if (c == '\n' && !words.empty())
+				break;
+		} else {
+			word.push_back(c);
+		}
 	}
+	if (!word.empty())
+		words.push_back(std::move(word));
+	auto target_end = std::find_if(words.begin(), words.end(), [](const std::string &w) { return w.ends_with(':'); });
+	if (target_end == words.end())
+		return false;
+	// the same normalised path for every spelling of an include
+	std::filesystem::path source_path(std::filesystem::path(source).lexically_normal());
+	std::filesystem::path source_dir(source_path.parent_path());
+	std::unordered_set<std::string> seen;
+	deps.clear();
+	for (auto it = target_end + 1; it != words.end(); ++it) {
+		std::filesystem::path p(std::filesystem::path(*it).lexically_normal());
+		if (p == source_path)
+			continue;
+		std::string dep(p.is_absolute() ? p.string() : p.lexically_relative(source_dir).string());
+		if (!dep.empty() && seen.insert(dep).second)
+			deps.push_back(dep);
+	}
+	return true;
+}
+std::set<std::string> file_dependencies::included_files(const std::string &file) const {
+	std::set<std::string> files;
+	std::vector<std::string> todo{ file };
+	while (!todo.empty()) {
+		std::string f(std::move(todo.back()));
+		todo.pop_back();
+		auto it = find(f);
+		if (it == end())
+			continue;
+		for (const auto &d : it->second) {
+			std::string dp(resolve_dependency(f, d));
+			if (files.insert(dp).second)
+				todo.push_back(dp);
+		}
+	}
+	return files;
 }
 bool file_dependencies::load_saved(const std::string &file) {
+	state_reader state;
+	if (state.open(file, state_kind::FILE_DEPENDENCIES, sizeof(file_dependencies_record))) {
+		compiler_deps.clear();
+		for (uint64_t i = 0; i < state.records(); ++i) {
+			file_dependencies_record rec(state.record<file_dependencies_record>(i));
+			if (rec.first_dep > state.refs() || rec.dep_count > state.refs() - rec.first_dep)
+				continue;
+			std::vector<std::string> deps;
+			deps.reserve(rec.dep_count);
+			for (uint64_t d = rec.first_dep; d < rec.first_dep + rec.dep_count; ++d)
+				deps.emplace_back(state.string(state.ref(d)));
+			auto it = emplace_hint(end(), state.string(rec.file), std::move(deps));
+			if (rec.flags & deps_from_compiler)
+				compiler_deps.insert(it->first);
+		}
+		return false;
+	}
+	// text format of older versions, other binary versions are dropped
+	if (is_state_file(file))
+		return false;
 	std::ifstream f(file);
 	if (f.bad())
 		return true;
@@ -109,17 +487,17 @@ bool file_dependencies::load_saved(const std::string &file) {
 	return false;
 }
 bool file_dependencies::save(const std::string &file) const {
-	std::ofstream f(file);
-	if (f.bad())
-		return true;
+	state_writer state;
 	for (const auto &filedata : *this) {
-		f << filedata.first << ':';
+		file_dependencies_record rec{ state.add_string(filedata.first), has_compiler_deps(filedata.first) ? deps_from_compiler : 0, 0, filedata.second.size() };
 		for (const auto &dep : filedata.second) {
-			f << dep << ':';
+			uint64_t ref = state.add_ref(state.add_string(dep));
+			if (&dep == &filedata.second.front())
+				rec.first_dep = ref;
 		}
-		f << std::endl;
+		state.add_record(rec);
 	}
-	return false;
+	return state.write(file, state_kind::FILE_DEPENDENCIES);
 }
 
 void dependency_info::load(category &cat) {
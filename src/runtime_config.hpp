@@ -4,7 +4,10 @@
 #include <inttypes.h>
 #include <filesystem>
 #include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "parsing/par.hpp"
 #include "project_utils.hpp"
@@ -29,18 +32,81 @@ public:
 
 class file_dependencies : public std::map<std::string, std::vector<std::string>> {
 public:
+	// scans #include "..." lines
 	void save_c_cpp_deps(const std::string &file);
+	// dependencies the compiler reported in a depfile replace the scanned ones, later scans only add to them
+	void set_compiler_deps(const std::string &file, std::vector<std::string> deps);
+	bool has_compiler_deps(const std::string &file) const;
+	// reads a make style depfile (-MMD -MF) of the source, paths end up relative to the source's directory like includes
+	static bool read_depfile(const std::string &depfile, const std::string &source, std::vector<std::string> &deps);
+	std::set<std::string> included_files(const std::string &file) const;
 	bool load_saved(const std::string &file);
 	bool save(const std::string &file) const;
+private:
+	std::set<std::string> compiler_deps;
+};
+// size and modification time tell when the content hash has to be recomputed, the hash decides whether a file changed
+struct file_stamp {
+	uint64_t size = 0;
+	uint64_t mtime = 0;
+	uint64_t hash = 0;
+	uint64_t builds = 0; // in the history - successful builds since the hash last changed
 };
-class file_history : public std::map<std::string, uint64_t> {
+// stamps the file, rehashing only when it's not cached or loaded from a history with the same size and modification time (thread safe)
+file_stamp current_stamp(const std::string &file);
+class file_history : public std::map<std::string, file_stamp> {
 public:
 	bool was_updated(const std::string &file) const;
-	bool was_updated(const std::string &file, const file_dependencies &deps, unsigned int depth=0) const;
 	void update(const std::string &file);
 	bool load_saved(const std::string &file);
 	bool save(const std::string &file) const;
 };
+// whether files or anything they include changed since the history was updated, and signatures of their inputs
+// every file is visited once - results are memoized across queries, include cycles (strongly connected components) share them
+class input_state {
+public:
+	input_state(const file_dependencies &deps, const file_history *hist=nullptr);
+	bool updated(const std::string &file);
+	uint64_t signature(const std::string &file);
+	// uses these includes of the file instead of the known ones (before any query)
+	void set_includes(const std::string &file, std::vector<std::string> includes);
+private:
+	struct result {
+		bool updated;
+		uint64_t signature;
+	};
+	const file_dependencies &deps;
+	const file_history *hist;
+	std::unordered_map<std::string, std::vector<std::string>> includes;
+	std::unordered_map<std::string, result> done;
+
+	const result &visit(const std::string &file);
+};
+// the program's --version output, asked again only when the executable it resolves to changed (path, size or mtime)
+uint64_t program_identity(const std::string &program);
+// whether an executable asked for its identity changed since
+bool programs_changed();
+// hash of the arguments and the identity of the program
+uint64_t command_fingerprint(const std::vector<std::string> &cmd);
+// the file the compiler driver links for -l<lib>, empty when it doesn't know
+// (asked again when the compiler changed or the file is gone)
+std::string find_library(const std::string &compiler, const std::string &lib);
+// what every object file was last successfully built from - appended to a journal right after each compile
+class object_history : public std::map<std::string, uint64_t> {
+public:
+	// input_state signature of the file - content of the file and everything it includes
+	static uint64_t input_stamp(const std::string &file, const file_dependencies &deps);
+	// what is recorded - the inputs and the command that compiled them
+	static uint64_t object_stamp(uint64_t inputs, uint64_t command);
+	bool load_saved(const std::string &file);
+	bool record(const std::string &obj, uint64_t stamp);
+	// 0 when unknown, safe while other jobs record
+	uint64_t recorded(const std::string &obj) const;
+	bool save(const std::string &file) const;
+private:
+	std::string journal;
+	mutable std::mutex journal_mutex;
+};
 class dependency {
 public:
 	enum build_system_t { PYRUVIC, CMAKE, HEADERONLY };
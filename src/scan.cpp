@@ -0,0 +1,164 @@
+#include "scan.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <array>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+constexpr unsigned int max_scan_threads = 8;
+
+std::unordered_map<std::string, file_stat> scanned;
+std::mutex scanned_mutex;
+
+#ifdef __linux__
+bool statx_file(int dirfd, const char *path, file_stat &st, bool &is_dir) {
+	struct statx stx;
+	if (statx(dirfd, path, AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx))
+		return false;
+	st.exists = true;
+	st.size = stx.stx_size;
+	st.mtime = static_cast<uint64_t>(stx.stx_mtime.tv_sec) * 1000000000ull + stx.stx_mtime.tv_nsec;
+	is_dir = S_ISDIR(stx.stx_mode);
+	return true;
+}
+// lists one directory with getdents64 and stats the entries relative to it, subdirectories are returned
+std::vector<std::string> scan_dir(const std::string &dir, std::vector<std::pair<std::string, file_stat>> &files) {
+	std::vector<std::string> subdirs;
+	int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return subdirs;
+	alignas(dirent64) std::array<char, 32768> buffer; // dirent64 matches the records of the getdents64 syscall
+	long len;
+	while ((len = syscall(SYS_getdents64, fd, buffer.data(), buffer.size())) > 0) {
+		for (long pos = 0; pos < len;) {
+			const dirent64 *ent = reinterpret_cast<const dirent64 *>(buffer.data() + pos);
+			pos += ent->d_reclen;
+			std::string name(ent->d_name);
+			if (name == "." || name == "..")
+				continue;
+			std::string path(dir.ends_with('/') ? dir + name : dir + "/" + name);
+			if (ent->d_type == DT_DIR) {
+				subdirs.push_back(path);
+				continue;
+			}
+			// like recursive_directory_iterator, links are followed for the type but linked directories aren't entered
+			file_stat st;
+			bool is_dir;
+			if (!statx_file(fd, ent->d_name, st, is_dir))
+				continue;
+			if (!is_dir)
+				files.emplace_back(std::move(path), st);
+			else if (ent->d_type == DT_UNKNOWN) // file systems that don't report types
+				subdirs.push_back(path);
+		}
+	}
+	close(fd);
+	return subdirs;
+}
+std::vector<std::string> scan_tree(const std::string &dir) {
+	std::deque<std::string> todo{ dir };
+	std::vector<std::pair<std::string, file_stat>> files;
+	std::mutex todo_mutex;
+	std::condition_variable todo_cv;
+	unsigned int busy = 0;
+	auto work = [&]() {
+		std::vector<std::pair<std::string, file_stat>> found;
+		std::unique_lock<std::mutex> lock(todo_mutex);
+		while (true) {
+			todo_cv.wait(lock, [&]() { return !todo.empty() || busy == 0; });
+			if (todo.empty())
+				break;
+			std::string d(std::move(todo.front()));
+			todo.pop_front();
+			++busy;
+			lock.unlock();
+			std::vector<std::string> subdirs(scan_dir(d, found));
+			lock.lock();
+			--busy;
+			todo.insert(todo.end(), subdirs.begin(), subdirs.end());
+			todo_cv.notify_all();
+		}
+		files.insert(files.end(), found.begin(), found.end());
+	};
+	unsigned int threadc = std::clamp(std::thread::hardware_concurrency(), 1u, max_scan_threads);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadc; ++i)
+		threads.emplace_back(work);
+	work();
+	for (auto &t : threads)
+		t.join();
+
+	std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+	std::vector<std::string> paths;
+	std::lock_guard<std::mutex> lock(scanned_mutex);
+	scanned.clear();
+	for (auto &f : files) {
+		paths.push_back(f.first);
+		scanned.emplace(std::move(f.first), f.second);
+	}
+	return paths;
+}
+file_stat stat_file(const std::string &file) {
+	{
+		std::lock_guard<std::mutex> lock(scanned_mutex);
+		auto it = scanned.find(file);
+		if (it != scanned.end())
+			return it->second;
+	}
+	file_stat st;
+	bool is_dir;
+	statx_file(AT_FDCWD, file.c_str(), st, is_dir);
+	return st;
+}
+#else
+std::vector<std::string> scan_tree(const std::string &dir) {
+	std::vector<std::string> paths;
+	std::lock_guard<std::mutex> lock(scanned_mutex);
+	scanned.clear();
+	for (const auto &dir_entry : std::filesystem::recursive_directory_iterator(dir)) {
+		if (dir_entry.is_directory())
+			continue;
+		std::error_code ec;
+		file_stat st{ true, dir_entry.file_size(ec), static_cast<uint64_t>(dir_entry.last_write_time(ec).time_since_epoch().count()) };
+		paths.push_back(dir_entry.path().string());
+		scanned.emplace(paths.back(), st);
+	}
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+file_stat stat_file(const std::string &file) {
+	{
+		std::lock_guard<std::mutex> lock(scanned_mutex);
+		auto it = scanned.find(file);
+		if (it != scanned.end())
+			return it->second;
+	}
+	file_stat st;
+	std::error_code ec;
+	st.size = std::filesystem::file_size(file, ec);
+	if (ec)
+		return st;
+	st.exists = true;
+	st.mtime = static_cast<uint64_t>(std::filesystem::last_write_time(file, ec).time_since_epoch().count());
+	return st;
+}
+#endif
+void forget_scanned(const std::string &file) {
+	std::lock_guard<std::mutex> lock(scanned_mutex);
+	scanned.erase(file);
+}
+void drop_tree_scan() {
+	std::lock_guard<std::mutex> lock(scanned_mutex);
+	scanned.clear();
+}
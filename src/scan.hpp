@@ -0,0 +1,22 @@
+#ifndef __SCAN_HPP__
+#define __SCAN_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct file_stat {
+	bool exists = false;
+	uint64_t size = 0;
+	uint64_t mtime = 0; // only compared for equality, units depend on the platform
+};
+
+// scans the tree once (subdirectories in parallel) and returns its files sorted
+// until drop_tree_scan, stat_file answers paths from the tree without touching the filesystem again
+std::vector<std::string> scan_tree(const std::string &dir);
+// the file was written after the scan
+void forget_scanned(const std::string &file);
+void drop_tree_scan();
+file_stat stat_file(const std::string &file);
+
+#endif
@@ -0,0 +1,141 @@
+#include "state_file.hpp"
+
+#include <fstream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "util.hpp"
+
+struct state_header {
+	char magic[4];
+	uint32_t byte_order;
+	uint32_t version;
+	uint32_t kind;
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t record_count;
+	uint64_t ref_count;
+	uint64_t strings_size;
+};
+static_assert(sizeof(state_header) == 48);
+constexpr char state_magic[4] = { 'P', 'Y', 'R', 'S' };
+constexpr uint32_t state_byte_order = 0x01020304;
+
+bool is_state_file(const std::string &file) {
+	std::ifstream f(file, std::ios::binary);
+	char magic[sizeof(state_magic)];
+	return f.read(magic, sizeof(magic)) && memcmp(magic, state_magic, sizeof(magic)) == 0;
+}
+
+state_reader::~state_reader() {
+	close();
+}
+void state_reader::close() {
+#ifdef __linux__
+	if (data && buffer.empty())
+		munmap(const_cast<char *>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+	buffer.clear();
+}
+bool state_reader::open(const std::string &file, state_kind kind, uint32_t record_size) {
+	close();
+#ifdef __linux__
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(state_header))) {
+		::close(fd);
+		return false;
+	}
+	void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+	data = static_cast<const char *>(mapped);
+	size = st.st_size;
+#else
+	std::ifstream f(file, std::ios::binary);
+	if (!f.good())
+		return false;
+	buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	if (buffer.size() < sizeof(state_header)) {
+		buffer.clear();
+		return false;
+	}
+	data = buffer.data();
+	size = buffer.size();
+#endif
+	state_header header;
+	memcpy(&header, data, sizeof(header));
+	bool valid = memcmp(header.magic, state_magic, sizeof(state_magic)) == 0 && header.byte_order == state_byte_order &&
+		header.version == state_format_version && header.kind == static_cast<uint32_t>(kind) &&
+		(header.record_size == record_size || header.record_count == 0) &&
+		header.record_count <= size && header.ref_count <= size && header.strings_size <= size;
+	records_start = sizeof(header);
+	refs_start = records_start + header.record_count * record_size;
+	strings_start = refs_start + header.ref_count * sizeof(state_string);
+	if (!valid || strings_start + header.strings_size != size) {
+		close();
+		return false;
+	}
+	record_count = header.record_count;
+	ref_count = header.ref_count;
+	strings_size = header.strings_size;
+	return true;
+}
+uint64_t state_reader::records() const {
+	return record_count;
+}
+uint64_t state_reader::refs() const {
+	return ref_count;
+}
+state_string state_reader::ref(uint64_t i) const {
+	state_string s;
+	memcpy(&s, data + refs_start + i * sizeof(state_string), sizeof(s));
+	return s;
+}
+std::string_view state_reader::string(state_string s) const {
+	if (static_cast<uint64_t>(s.offset) + s.size > strings_size)
+		return std::string_view();
+	return std::string_view(data + strings_start + s.offset, s.size);
+}
+
+state_string state_writer::add_string(std::string_view str) {
+	// strings are interned, every path is stored once
+	auto it = interned.find(std::string(str));
+	if (it != interned.end())
+		return it->second;
+	state_string s{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size()) };
+	strings.append(str);
+	interned.emplace(str, s);
+	return s;
+}
+uint64_t state_writer::add_ref(state_string s) {
+	refs.append(reinterpret_cast<const char *>(&s), sizeof(s));
+	return refs.size() / sizeof(state_string) - 1;
+}
+bool state_writer::write(const std::string &file, state_kind kind) const {
+	state_header header;
+	memcpy(header.magic, state_magic, sizeof(state_magic));
+	header.byte_order = state_byte_order;
+	header.version = state_format_version;
+	header.kind = static_cast<uint32_t>(kind);
+	header.record_size = record_size;
+	header.reserved = 0;
+	header.record_count = record_size ? records.size() / record_size : 0;
+	header.ref_count = refs.size() / sizeof(state_string);
+	header.strings_size = strings.size();
+	std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+	data.reserve(sizeof(header) + records.size() + refs.size() + strings.size());
+	data += records;
+	data += refs;
+	data += strings;
+	// unique temporary file - another build of the project might write at the same time
+	return !replace_file(file, data);
+}
@@ -0,0 +1,72 @@
+#ifndef __STATE_FILE_HPP__
+#define __STATE_FILE_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// versioned binary format of the files in ./.pyr/ - header, fixed size records, string references, string table
+// the file is mapped and read in place, records and references are in native byte order (files from other machines are rejected)
+constexpr uint32_t state_format_version = 2;
+enum class state_kind : uint32_t { FILE_HISTORY = 1, FILE_DEPENDENCIES = 2 };
+
+struct state_string {
+	uint32_t offset;
+	uint32_t size;
+};
+
+// whether the file starts like a state file (of any version and kind)
+bool is_state_file(const std::string &file);
+
+class state_reader {
+public:
+	~state_reader();
+	// false when the file is missing or not a valid state file of this kind and record size (e.g. an old text file)
+	bool open(const std::string &file, state_kind kind, uint32_t record_size);
+	uint64_t records() const;
+	template<typename T> T record(uint64_t i) const {
+		T rec;
+		memcpy(&rec, data + records_start + i * sizeof(T), sizeof(T));
+		return rec;
+	}
+	uint64_t refs() const;
+	state_string ref(uint64_t i) const;
+	// empty view for references outside the string table
+	std::string_view string(state_string s) const;
+private:
+	const char *data = nullptr;
+	size_t size = 0;
+	std::vector<char> buffer; // without mmap
+	uint64_t record_count = 0;
+	uint64_t ref_count = 0;
+	uint64_t records_start = 0;
+	uint64_t refs_start = 0;
+	uint64_t strings_start = 0;
+	uint64_t strings_size = 0;
+
+	void close();
+};
+
+class state_writer {
+public:
+	state_string add_string(std::string_view str);
+	template<typename T> void add_record(const T &rec) {
+		record_size = sizeof(T);
+		records.append(reinterpret_cast<const char *>(&rec), sizeof(T));
+	}
+	// index of the reference
+	uint64_t add_ref(state_string s);
+	// writes a temporary file and renames it over the old one, true on error
+	bool write(const std::string &file, state_kind kind) const;
+private:
+	uint32_t record_size = 0;
+	std::string records;
+	std::string refs;
+	std::string strings;
+	std::unordered_map<std::string, state_string> interned;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "time_report.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include "formatted_out.hpp"
+#include "json.hpp"
+
+constexpr size_t time_report_entries = 10;
+
+struct time_entry {
+	double total = 0; // us
+	std::set<size_t> tus;
+};
+using time_table = std::map<std::string, time_entry>;
+
+std::string normalize_header(const std::string &file) {
+	std::filesystem::path p(file);
+	if (p.is_absolute())
+		return p.lexically_normal().string();
+	return ("./" / p.lexically_normal()).string();
+}
+void print_time_table(const std::string &title, const time_table &table, const std::map<std::string, unsigned int> *includers) {
+	std::vector<std::pair<std::string, const time_entry *>> sorted;
+	for (const auto &e : table)
+		sorted.emplace_back(e.first, &e.second);
+	std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second->total > b.second->total; });
+	if (sorted.size() > time_report_entries)
+		sorted.resize(time_report_entries);
+	std::cout << "\x1b[96m" << title << colReset << std::endl;
+	for (const auto &e : sorted) {
+		std::cout << std::setw(10) << std::fixed << std::setprecision(1) << e.second->total / 1000 << " ms  in " <<
+			std::setw(4) << e.second->tus.size() << " TUs";
+		if (includers) {
+			auto it = includers->find(e.first);
+			if (it != includers->end())
+				std::cout << ", included by " << std::setw(4) << it->second;
+			else
+				std::cout << "                 ";
+		}
+		std::cout << "  " << e.first << std::endl;
+	}
+}
+void print_time_report(const std::vector<std::string> &trace_files, const std::vector<std::string> &sources, const file_dependencies &fdeps) {
+	time_table headers;
+	time_table templates;
+	time_table functions;
+	double frontend = 0;
+	double backend = 0;
+	for (size_t i = 0; i < trace_files.size(); ++i) {
+		std::ifstream f(trace_files[i]);
+		if (!f.good())
+			continue;
+		std::stringstream ss;
+		ss << f.rdbuf();
+		json_value trace;
+		if (parse_json(ss.str(), trace)) {
+			std::cout << prettyErrorGeneral("failed parsing time trace " + trace_files[i], severity::WARN) << std::endl;
+			continue;
+		}
+		for (const auto &ev : trace["traceEvents"].arr) {
+			if (ev["ph"].str != "X")
+				continue;
+			const std::string &name = ev["name"].str;
+			const std::string &detail = ev["args"]["detail"].str;
+			double dur = ev["dur"].number;
+			time_table *table = nullptr;
+			std::string key(detail);
+			if (name == "Source") {
+				table = &headers;
+				key = normalize_header(detail);
+			} else if (name == "InstantiateClass" || name == "InstantiateFunction") {
+				table = &templates;
+			} else if (name == "ParseFunctionDefinition" || name == "CodeGen Function") {
+				table = &functions;
+			} else if (name == "Total Frontend") {
+				frontend += dur;
+			} else if (name == "Total Backend") {
+				backend += dur;
+			}
+			if (table && !key.empty()) {
+				time_entry &entry = (*table)[key];
+				entry.total += dur;
+				entry.tus.insert(i);
+			}
+		}
+	}
+	// how many translation units include each header according to the include graph
+	std::map<std::string, unsigned int> includers;
+	for (const auto &src : sources) {
+		for (const auto &header : fdeps.included_files(src))
+			++includers[header];
+	}
+	std::cout << prettyErrorGeneral("compile time report of " + std::to_string(trace_files.size()) + " translation units - frontend " +
+		std::to_string(static_cast<uint64_t>(frontend / 1000)) + " ms, backend " + std::to_string(static_cast<uint64_t>(backend / 1000)) + " ms", severity::INFO) << std::endl;
+	print_time_table("headers (inclusive parse time):", headers, &includers);
+	print_time_table("template instantiations:", templates, nullptr);
+	print_time_table("functions:", functions, nullptr);
+}
@@ -0,0 +1,11 @@
+#ifndef __TIME_REPORT_HPP__
+#define __TIME_REPORT_HPP__
+
+#include <string>
+#include <vector>
+#include "runtime_config.hpp"
+
+// merges clang -ftime-trace outputs and prints the most expensive headers, template instantiations and functions
+void print_time_report(const std::vector<std::string> &trace_files, const std::vector<std::string> &sources, const file_dependencies &fdeps);
+
+#endif
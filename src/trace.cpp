@@ -0,0 +1,78 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include "json.hpp"
+
+struct trace_event {
+	std::string name;
+	std::string cat;
+	unsigned int lane;
+	uint64_t start;
+	uint64_t dur;
+	trace_args args;
+};
+
+const auto trace_epoch = std::chrono::steady_clock::now();
+std::string trace_file;
+std::vector<trace_event> trace_events;
+std::vector<std::pair<unsigned int, std::string>> trace_lanes{ { 0, "main" } };
+std::mutex trace_mutex;
+
+void trace_enable(const std::string &file) {
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_file = file;
+	trace_events.clear();
+}
+bool trace_enabled() {
+	return !trace_file.empty();
+}
+uint64_t trace_now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+void trace_lane(unsigned int lane, const std::string &name) {
+	if (!trace_enabled())
+		return;
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	for (const auto &l : trace_lanes) {
+		if (l.first == lane)
+			return;
+	}
+	trace_lanes.emplace_back(lane, name);
+}
+void trace_slice(const std::string &name, const std::string &cat, unsigned int lane, uint64_t start, uint64_t dur, const trace_args &args) {
+	if (!trace_enabled())
+		return;
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_events.push_back(trace_event{ name, cat, lane, start, dur, args });
+}
+bool trace_write() {
+	if (!trace_enabled())
+		return false;
+	std::ofstream f(trace_file);
+	if (!f.good())
+		return true;
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	f << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto &l : trace_lanes) {
+		f << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << l.first <<
+			",\"args\":{\"name\":" << json_str(l.second) << "}}";
+		first = false;
+	}
+	for (const auto &ev : trace_events) {
+		f << ",\n{\"name\":" << json_str(ev.name) << ",\"cat\":" << json_str(ev.cat) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ev.lane <<
+			",\"ts\":" << ev.start << ",\"dur\":" << ev.dur << ",\"args\":{";
+		for (size_t i = 0; i < ev.args.size(); ++i)
+			f << (i ? "," : "") << json_str(ev.args[i].first) << ":" << ev.args[i].second;
+		f << "}}";
+	}
+	f << "\n]}" << std::endl;
+	return !f.good();
+}
+
+trace_scope::trace_scope(const std::string &name, const std::string &cat) : name(name), cat(cat), start(trace_now()) { }
+trace_scope::~trace_scope() {
+	trace_slice(name, cat, 0, start, trace_now() - start);
+}
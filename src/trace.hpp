@@ -0,0 +1,30 @@
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// chrome trace event format (chrome://tracing, ui.perfetto.dev) - lane 0 is the main thread, workers use 1...
+using trace_args = std::vector<std::pair<std::string, std::string>>; // values are json
+
+// starts a new trace, an empty file name disables tracing
+void trace_enable(const std::string &file);
+bool trace_enabled();
+uint64_t trace_now();
+void trace_lane(unsigned int lane, const std::string &name);
+void trace_slice(const std::string &name, const std::string &cat, unsigned int lane, uint64_t start, uint64_t dur, const trace_args &args={});
+bool trace_write();
+
+class trace_scope {
+public:
+	trace_scope(const std::string &name, const std::string &cat);
+	~trace_scope();
+private:
+	std::string name;
+	std::string cat;
+	uint64_t start;
+};
+
+#endif
@@ -1,10 +1,16 @@
 #include "util.hpp"
+#include <algorithm>
 #include <string>
 #include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
 #ifdef _WIN32
+#include <io.h>
 #include <windows.h>
 #endif
 #ifdef __linux__
+#include <unistd.h>
 #endif
 
 std::string get_exe_path() {
@@ -21,27 +27,134 @@ std::string get_exe_path() {
 	return "";
 }
 
-bool command_exists(const std::string &cmd) {
-	if (std::filesystem::path(cmd).is_absolute())
-		return std::filesystem::exists(cmd);
-	std::string path(getenv("PATH"));
+std::string find_command(const std::string &cmd) {
+	if (cmd.find_first_of("/\\") != std::string::npos)
+		return std::filesystem::exists(cmd) ? cmd : "";
+	const char *env = getenv("PATH");
+	std::string path(env ? env : "");
 #ifdef _WIN32
-	for (size_t i = 0, j; (j = path.find(';', i+1)) != std::string::npos; i = j) {
-		std::filesystem::path p(path.substr(i+1, j-i-1));
-		if (std::filesystem::exists(p + "/" + cmd + ".com"))
-			return true;
-		if (std::filesystem::exists(p + "/" + cmd + ".exe"))
-			return true;
-		if (std::filesystem::exists(p + "/" + cmd + ".bat"))
-			return true;
+	for (size_t i = 0; i <= path.size();) {
+		size_t j = std::min(path.find(';', i), path.size());
+		std::string dir(path.substr(i, j - i));
+		for (const char *ext : { ".com", ".exe", ".bat" }) {
+			if (!dir.empty() && std::filesystem::exists(dir + "/" + cmd + ext))
+				return dir + "/" + cmd + ext;
+		}
+		i = j + 1;
 	}
 #endif
 #ifdef __linux__
-	for (size_t i = 0, j; (j = path.find(':', i+1)) != std::string::npos; i = j) {
-		std::filesystem::path p(path.substr(i+1, j-i-1) + "/" + cmd);
-		if (std::filesystem::exists(p))
-			return true;
+	for (size_t i = 0; i <= path.size();) {
+		size_t j = std::min(path.find(':', i), path.size());
+		std::string file(path.substr(i, j - i) + "/" + cmd);
+		if (j > i && std::filesystem::exists(file))
+			return file;
+		i = j + 1;
+	}
+#endif
+	return "";
+}
+bool command_exists(const std::string &cmd) {
+	return !find_command(cmd).empty();
+}
+bool is_clang(const std::string &compiler) {
+	return std::filesystem::path(compiler).filename().string().find("clang") != std::string::npos;
+}
+// in KiB, 0 when unknown
+uint64_t available_memory() {
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status))
+		return status.ullAvailPhys / 1024;
+#endif
+#ifdef __linux__
+	// "name: value [unit]" per line, some lines (counts) have no unit
+	std::ifstream f("/proc/meminfo");
+	std::string line;
+	while (std::getline(f, line)) {
+		std::stringstream ss(line);
+		std::string name;
+		uint64_t val;
+		std::string unit;
+		if (!(ss >> name >> val) || name != "MemAvailable:")
+			continue;
+		ss >> unit;
+		if (unit == "kB")
+			return val;
+		if (unit == "MB")
+			return val * 1024;
+		if (unit == "GB")
+			return val * 1024 * 1024;
+		if (unit.empty() || unit == "B")
+			return val / 1024;
+		return 0;
 	}
 #endif
-	return false;
+	return 0;
+}
+bool is_interactive() {
+#ifdef _WIN32
+	return _isatty(_fileno(stdout));
+#else
+	return isatty(STDOUT_FILENO);
+#endif
+}
+bool read_file(const std::string &file, std::string &data) {
+	std::ifstream f(file, std::ios::binary);
+	if (!f.good())
+		return false;
+	std::stringstream ss;
+	ss << f.rdbuf();
+	data = ss.str();
+	return !f.bad();
+}
+bool replace_file(const std::string &file, const std::string &data) {
+	std::string tmp(file + ".tmp" + std::to_string(std::random_device()()));
+	std::error_code ec, cleanup_ec;
+	{
+		std::ofstream f(tmp, std::ios::binary);
+		f.write(data.data(), data.size());
+		// closing flushes, which can fail too
+		f.close();
+		if (f.fail()) {
+			std::filesystem::remove(tmp, cleanup_ec);
+			return false;
+		}
+	}
+	std::filesystem::rename(tmp, file, ec);
+	if (ec) {
+		std::filesystem::remove(tmp, cleanup_ec);
+		return false;
+	}
+	return true;
+}
+void for_each_code_line(const std::string &file, const std::function<bool(const std::string &)> &f) {
+	std::ifstream in(file);
+	std::string line;
+	bool comment = false;
+	while (std::getline(in, line)) {
+		std::string code;
+		for (size_t i = 0; i < line.size(); ++i) {
+			if (comment) {
+				if (line.compare(i, 2, "*/") == 0) {
+					comment = false;
+					++i;
+				}
+			} else if (line.compare(i, 2, "//") == 0) {
+				break;
+			} else if (line.compare(i, 2, "/*") == 0) {
+				comment = true;
+				++i;
+			} else {
+				code.push_back(line[i]);
+			}
+		}
+		size_t start = code.find_first_not_of(" \t\r");
+		if (start == std::string::npos)
+			continue;
+		code = code.substr(start, code.find_last_not_of(" \t\r") - start + 1);
+		if (!f(code))
+			return;
+	}
 }
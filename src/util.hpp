@@ -1,9 +1,23 @@
 #ifndef __UTIL_HPP__
 #define __UTIL_HPP__
 
+#include <cstdint>
+#include <functional>
 #include <string>
 
 std::string get_exe_path();
+// the file run for the command (searched in PATH), empty when there is none
+std::string find_command(const std::string &cmd);
 bool command_exists(const std::string &cmd);
+// by the name of the compiler, gcc otherwise
+bool is_clang(const std::string &compiler);
+uint64_t available_memory();
+bool is_interactive();
+// whole file, false when it couldn't be read
+bool read_file(const std::string &file, std::string &data);
+// writes a temporary file next to it and renames it over the file, so readers never see a partial one - false on error
+bool replace_file(const std::string &file, const std::string &data);
+// calls f with every line of code (comments removed, trimmed) until it returns false
+void for_each_code_line(const std::string &file, const std::function<bool(const std::string &)> &f);
 
 #endif
@@ -0,0 +1,124 @@
+#include "watcher.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+constexpr const char *watched_dir = "./src/";
+constexpr const char *watched_proj_file = "pyruvic.projinfo";
+constexpr int settle_time = 50; // ms
+
+#ifdef __linux__
+file_watcher::~file_watcher() {
+	if (fd >= 0)
+		close(fd);
+}
+bool file_watcher::init() {
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return true;
+	// the directory is watched instead of the project file, editors often replace files by renaming
+	int wd = inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0)
+		return true;
+	dirs[wd] = ".";
+	add_dir(watched_dir);
+	return false;
+}
+void file_watcher::add_dir(const std::string &dir) {
+	int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR);
+	if (wd < 0)
+		return;
+	dirs[wd] = dir;
+	std::error_code ec;
+	for (const auto &dir_entry : std::filesystem::directory_iterator(dir, ec)) {
+		if (dir_entry.is_directory())
+			add_dir(dir_entry.path().string());
+	}
+}
+bool file_watcher::read_events(int timeout_ms, std::set<std::string> &changed) {
+	pollfd pfd{ fd, POLLIN, 0 };
+	int n = poll(&pfd, 1, timeout_ms);
+	if (n <= 0)
+		return false;
+	alignas(inotify_event) std::array<char, 16384> buffer;
+	ssize_t len;
+	while ((len = read(fd, buffer.data(), buffer.size())) > 0) {
+		for (char *p = buffer.data(); p < buffer.data() + len;) {
+			const inotify_event *ev = reinterpret_cast<const inotify_event *>(p);
+			p += sizeof(inotify_event) + ev->len;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				changed.insert(watched_dir); // events were lost, anything might have changed
+				continue;
+			}
+			if (ev->mask & IN_IGNORED) {
+				dirs.erase(ev->wd);
+				continue;
+			}
+			auto dir = dirs.find(ev->wd);
+			if (dir == dirs.end() || ev->len == 0)
+				continue;
+			if (dir->second == ".") {
+				if (std::string(ev->name) == watched_proj_file)
+					changed.insert("./" + std::string(watched_proj_file));
+				continue;
+			}
+			std::string file((std::filesystem::path(dir->second) / ev->name).string());
+			if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+				add_dir(file);
+			changed.insert(file);
+		}
+	}
+	return !changed.empty();
+}
+std::set<std::string> file_watcher::wait(int timeout_ms) {
+	std::set<std::string> changed;
+	if (read_events(timeout_ms, changed)) {
+		while (read_events(settle_time, changed)) { }
+	}
+	return changed;
+}
+#else
+file_watcher::~file_watcher() { }
+bool file_watcher::init() {
+	mtimes = scan();
+	return false;
+}
+std::map<std::string, uint64_t> file_watcher::scan() const {
+	std::map<std::string, uint64_t> res;
+	std::error_code ec;
+	for (const auto &dir_entry : std::filesystem::recursive_directory_iterator(watched_dir, ec)) {
+		if (!dir_entry.is_directory())
+			res[dir_entry.path().string()] = static_cast<uint64_t>(dir_entry.last_write_time(ec).time_since_epoch().count());
+	}
+	std::string proj_file("./" + std::string(watched_proj_file));
+	res[proj_file] = static_cast<uint64_t>(std::filesystem::last_write_time(proj_file, ec).time_since_epoch().count());
+	return res;
+}
+std::set<std::string> file_watcher::wait(int timeout_ms) {
+	std::set<std::string> changed;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (changed.empty() && (timeout_ms < 0 || std::chrono::steady_clock::now() < deadline)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms < 0 ? 500 : std::min(timeout_ms, 500)));
+		std::map<std::string, uint64_t> now(scan());
+		for (const auto &f : now) {
+			auto it = mtimes.find(f.first);
+			if (it == mtimes.end() || it->second != f.second)
+				changed.insert(f.first);
+		}
+		for (const auto &f : mtimes) {
+			if (!now.contains(f.first))
+				changed.insert(f.first);
+		}
+		mtimes = std::move(now);
+	}
+	return changed;
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef __WATCHER_HPP__
+#define __WATCHER_HPP__
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+// reports files changed under ./src/ and the project file - inotify on linux, polling modification times elsewhere
+class file_watcher {
+public:
+	~file_watcher();
+	bool init();
+	// waits up to timeout_ms (-1 = forever) for changes, then collects the ones that follow shortly after (editors save in steps)
+	std::set<std::string> wait(int timeout_ms);
+private:
+#ifdef __linux__
+	int fd = -1;
+	std::map<int, std::string> dirs;
+
+	void add_dir(const std::string &dir);
+	bool read_events(int timeout_ms, std::set<std::string> &changed);
+#else
+	std::map<std::string, uint64_t> mtimes;
+
+	std::map<std::string, uint64_t> scan() const;
+#endif
+};
+
+#endif